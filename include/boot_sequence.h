@@ -0,0 +1,62 @@
+#ifndef BOOT_SEQUENCE_H
+#define BOOT_SEQUENCE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Show a broker hint if MQTT is still down this long after the IP came up
+#define BOOT_MQTT_HINT_MS 5000
+
+  /**
+   * Boot milestones, in the order they normally happen
+   * Wi-Fi and MQTT run in the background, so they may land before or after
+   * the local phases.
+   */
+  typedef enum
+  {
+    BOOT_PHASE_APP_MAIN,    // app_main entered
+    BOOT_PHASE_RADIO,       // Wi-Fi started, associating in the background
+    BOOT_PHASE_PERIPHERALS, // LCD, buzzer, buttons and LEDs ready
+    BOOT_PHASE_SERVICES,    // MQTT client, outbox and other modules set up
+    BOOT_PHASE_READY,       // Main loop accepting presses
+    BOOT_PHASE_WIFI,        // Got an IP address
+    BOOT_PHASE_MQTT,        // First broker connection
+    BOOT_PHASE_COUNT
+  } boot_phase_t;
+
+  /**
+   * Record a phase (first call only) and log it with the time since power-on
+   */
+  void boot_mark(boot_phase_t phase);
+
+  /**
+   * Get when a phase happened
+   * @return Microseconds since power-on, or 0 if not reached yet
+   */
+  int64_t boot_phase_time_us(boot_phase_t phase);
+
+  /**
+   * Start Wi-Fi in the background (this also initializes NVS)
+   * Returns without waiting for an IP.
+   * @return ESP_OK on success
+   */
+  esp_err_t boot_start_network(void);
+
+  /**
+   * Connect MQTT as soon as there is an IP, or now if there already is one
+   * Call after mqtt_manager_init().
+   * @return ESP_OK on success
+   */
+  esp_err_t boot_connect_mqtt(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOT_SEQUENCE_H
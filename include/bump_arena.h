@@ -0,0 +1,66 @@
+#ifndef BUMP_ARENA_H
+#define BUMP_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C++ only, and free of IDF headers so host tools can use it too
+
+/**
+ * Bump allocator over a caller-owned buffer.
+ * alloc() hands out the next aligned block, individual frees are no-ops and
+ * reset() releases everything at once. Not thread-safe.
+ */
+class BumpArena
+{
+public:
+    // Enough for the doubles inside a cJSON node
+    static constexpr size_t ALIGN = 8;
+
+    constexpr BumpArena(uint8_t *buffer, size_t size)
+        : m_buffer(buffer), m_size(size), m_used(0), m_high_water(0)
+    {
+    }
+
+    /**
+     * @return Block of at least size bytes, or NULL if the arena is full
+     */
+    void *alloc(size_t size)
+    {
+        size = (size + ALIGN - 1) & ~(ALIGN - 1);
+        if (size > m_size - m_used)
+            return NULL;
+
+        void *block = m_buffer + m_used;
+        m_used += size;
+        if (m_used > m_high_water)
+            m_high_water = m_used;
+        return block;
+    }
+
+    /**
+     * @return true if ptr was handed out by this arena
+     */
+    bool owns(const void *ptr) const
+    {
+        const uint8_t *p = (const uint8_t *)ptr;
+        return p >= m_buffer && p < m_buffer + m_size;
+    }
+
+    /**
+     * Release every block
+     */
+    void reset() { m_used = 0; }
+
+    size_t used() const { return m_used; }
+    size_t high_water() const { return m_high_water; }
+    size_t capacity() const { return m_size; }
+
+private:
+    uint8_t *m_buffer;
+    size_t m_size;
+    size_t m_used;
+    size_t m_high_water;
+};
+
+#endif // BUMP_ARENA_H
@@ -3,6 +3,8 @@
 
 #include "esp_err.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -16,11 +18,16 @@ extern "C"
 #define BUTTON2_PIN GPIO_NUM_23
 #define BUTTON3_PIN GPIO_NUM_32
 
+// Raw press events buffered between the interrupt and button_get_event()
+#define BUTTON_QUEUE_LENGTH 20
+
   /**
  * Initialize button GPIOs and interrupts
+ * @param set Queue set to add the event queue to before the interrupts are
+ *            enabled (FreeRTOS only adds empty queues), or NULL
  * @return ESP_OK on success
  */
-  esp_err_t button_init(void);
+  esp_err_t button_init(QueueSetHandle_t set);
 
   /**
  * Check if a button was pressed and retrieve the event.
@@ -32,6 +39,22 @@ extern "C"
  */
   bool button_get_event(uint8_t *button_out, uint32_t wait_ms);
 
+  /**
+ * Same as button_get_event(), also returning when the press happened
+ * @param button_out Pointer to store the pressed button number (1, 2, or 3)
+ * @param time_us_out esp_timer time captured in the interrupt (may be NULL)
+ * @param wait_ms Time to wait for a button press in milliseconds
+ * @return true if a button press was detected
+ */
+  bool button_get_event_at(uint8_t *button_out, int64_t *time_us_out, uint32_t wait_ms);
+
+  /**
+ * Get the player identifier mapped to a button
+ * @param btn Button ID (1, 2, 3)
+ * @return Player ID (e.g. "meeple_1"), "unknown" for other IDs
+ */
+  const char *button_player_id(uint8_t btn);
+
   /**
  * Play the tone associated with a specific button
  * @param btn Button ID (1, 2, 3)
@@ -62,11 +85,30 @@ extern "C"
    */
   void button_set_debounce_time(uint32_t debounce_ms);
 
+  /**
+   * Set the active mask and debounce time together
+   * A press is filtered with both old or both new values, never a mix.
+   * @param mask Bitmask of active buttons
+   * @param debounce_ms Debounce time
+   */
+  void button_set_filter(button_active_mask_t mask, uint32_t debounce_ms);
+
   /**
    * Flush all pending events from the button queue
    */
   void button_flush_queue(void);
 
+  /**
+   * Get the raw event queue, so a caller can wait on it in a queue set
+   * Read events with button_get_event_at(..., 0) once the set selects it.
+   */
+  QueueHandle_t button_get_queue(void);
+
+  /**
+   * Get the number of raw events waiting in the button queue
+   */
+  uint32_t button_get_queue_depth(void);
+
 #ifdef __cplusplus
 }
 #endif
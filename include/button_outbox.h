@@ -0,0 +1,115 @@
+#ifndef BUTTON_OUTBOX_H
+#define BUTTON_OUTBOX_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// RAM ring capacity (button events)
+#define OUTBOX_CAPACITY 32
+
+// Spill to NVS when the RAM ring is full (0 to disable)
+#define OUTBOX_NVS_OVERFLOW 1
+#define OUTBOX_NVS_CAPACITY 64
+// Spilled events parked in RAM until the outbox task writes them to flash
+#define OUTBOX_SPILL_PENDING 8
+
+// Retransmit window: events sent but not yet acked by the server on
+// MQTT_TOPIC_BUTTON_ACK. Only used when the server advertised acks.
+#define OUTBOX_WINDOW 8
+#define OUTBOX_ACK_TIMEOUT_MS 2000
+
+// Default spacing between replayed events after a reconnect
+#define OUTBOX_REPLAY_INTERVAL_MS 50
+// Poll interval while waiting for the connection to come back
+#define OUTBOX_RETRY_MS 500
+// Poll interval while a new connection waits for the server's capability reply
+#define OUTBOX_CAPS_POLL_MS 20
+
+#define OUTBOX_TASK_PRIORITY 3
+#define OUTBOX_TASK_STACK_SIZE 3072
+
+  /**
+   * What to discard when RAM (and NVS) are full
+   */
+  typedef enum
+  {
+    OUTBOX_DROP_OLDEST,
+    OUTBOX_DROP_NEWEST
+  } outbox_drop_policy_t;
+
+  /**
+   * A button press as captured, replayed unchanged
+   */
+  typedef struct
+  {
+    uint32_t seq;
+    int64_t timestamp_ms;
+    uint8_t button;
+  } button_record_t;
+
+  /**
+   * Outbox metrics
+   */
+  typedef struct
+  {
+    uint32_t session;    // Per-boot session ID sent with every event
+    uint32_t depth;      // Events waiting or unacked (RAM + NVS)
+    uint32_t inflight;   // Events sent and awaiting an ack
+    uint32_t nvs_depth;  // Events spilled to NVS
+    uint32_t high_water; // Deepest the queue has been
+    uint32_t sent;       // Events published
+    uint32_t replayed;   // Events published after waiting for a reconnect
+    uint32_t acked;      // Events confirmed by the server
+    uint32_t retransmits; // Events sent again after an ack timeout
+    uint32_t dropped;    // Events discarded by the drop policy
+    outbox_drop_policy_t policy;
+  } outbox_metrics_t;
+
+  /**
+ * Initialize the outbox and start its sender task
+ * Any events spilled to NVS by a previous boot are discarded: their
+ * timestamps are relative to that boot.
+ * @return ESP_OK on success
+ */
+  esp_err_t outbox_init(void);
+
+  /**
+ * Queue a button press for delivery
+ * Events go out immediately while connected and are held, in order, while not.
+ * Each event carries the boot's session ID and a monotonic sequence number so
+ * the server can discard duplicates. If the server acks, events stay queued
+ * until a cumulative ack covers them and are resent (go-back-N) on timeout
+ * or reconnect; otherwise they are released once published.
+ * @param button Button number (1, 2, or 3)
+ * @param timestamp_ms Capture timestamp in milliseconds
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if dropped (OUTBOX_DROP_NEWEST)
+ */
+  esp_err_t outbox_push(uint8_t button, int64_t timestamp_ms);
+
+  /**
+ * Set what to discard when the outbox is full
+ */
+  void outbox_set_drop_policy(outbox_drop_policy_t policy);
+
+  /**
+ * Set the spacing between replayed events after a reconnect
+ * @param interval_ms Minimum gap between replayed events
+ */
+  void outbox_set_replay_interval(uint32_t interval_ms);
+
+  /**
+ * Get a snapshot of the outbox metrics
+ */
+  void outbox_get_metrics(outbox_metrics_t *metrics_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUTTON_OUTBOX_H
@@ -0,0 +1,90 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Each round sends a short burst of pings and keeps the lowest-RTT sample
+#define CLOCK_SYNC_BURST 4
+#define CLOCK_SYNC_BURST_GAP_MS 100
+#define CLOCK_SYNC_TIMEOUT_MS 500
+
+// Rounds run quickly until the estimate settles, then periodically
+#define CLOCK_SYNC_FAST_INTERVAL_MS 2000
+#define CLOCK_SYNC_FAST_ROUNDS 4
+#define CLOCK_SYNC_INTERVAL_MS 30000
+
+// Round results kept for the offset/drift fit
+#define CLOCK_SYNC_HISTORY 8
+// Samples slower than this multiple of the best RTT are left out of the fit
+#define CLOCK_SYNC_RTT_FILTER 2
+// Drift is only estimated over at least this much history
+#define CLOCK_SYNC_MIN_DRIFT_SPAN_MS 20000
+// Clamp for the drift estimate and extra uncertainty added per second of extrapolation
+#define CLOCK_SYNC_MAX_DRIFT_PPM 200
+#define CLOCK_SYNC_DRIFT_MARGIN_PPM 20
+
+#define CLOCK_SYNC_TASK_PRIORITY 2
+#define CLOCK_SYNC_TASK_STACK_SIZE 3072
+
+  /**
+   * Current clock estimate
+   */
+  typedef struct
+  {
+    bool synced;        // At least one round completed
+    int64_t offset_us;  // server_time - local_time at ref_local_us
+    int64_t ref_local_us;
+    float drift_ppm;    // Server clock rate relative to ours
+    uint32_t rtt_us;    // Best round-trip time in the history
+    uint32_t error_us;  // Error bound at ref_local_us
+    uint32_t samples;   // Pongs received
+    uint32_t rounds;    // Rounds completed
+    uint32_t timeouts;  // Pings that got no pong
+  } clock_sync_status_t;
+
+  /**
+   * Start periodic clock synchronization with the server
+   * Registers the pong handler; pings go out whenever MQTT is connected.
+   * @return ESP_OK on success
+   */
+  esp_err_t clock_sync_init(void);
+
+  /**
+   * Check whether an estimate is available
+   */
+  bool clock_sync_is_synced(void);
+
+  /**
+   * Convert a local esp_timer time to server time
+   * @param local_us Local time in microseconds (esp_timer_get_time())
+   * @param server_us_out Server time in microseconds
+   * @param error_us_out Error bound in microseconds (may be NULL)
+   * @return ESP_OK on success, ESP_ERR_INVALID_STATE before the first sync
+   */
+  esp_err_t clock_sync_to_server_us(int64_t local_us, int64_t *server_us_out, uint32_t *error_us_out);
+
+  /**
+   * Convert a server time to local esp_timer time
+   * @param server_us Server time in microseconds
+   * @param local_us_out Local time in microseconds
+   * @return ESP_OK on success, ESP_ERR_INVALID_STATE before the first sync
+   */
+  esp_err_t clock_sync_to_local_us(int64_t server_us, int64_t *local_us_out);
+
+  /**
+   * Get a snapshot of the clock estimate
+   */
+  void clock_sync_get_status(clock_sync_status_t *status_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLOCK_SYNC_H
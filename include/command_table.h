@@ -0,0 +1,149 @@
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// C++ only: tables are built and verified at compile time
+
+/**
+ * FNV-1a hash of a length-delimited string
+ * @param str String to hash (need not be null-terminated)
+ * @param len Length of str
+ * @param seed Value mixed into the offset basis
+ * @return 32-bit hash
+ */
+constexpr uint32_t str_hash(const char *str, size_t len, uint32_t seed = 0)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * strlen usable in constant expressions
+ */
+constexpr size_t const_strlen(const char *str)
+{
+    size_t len = 0;
+    while (str[len] != '\0')
+        len++;
+    return len;
+}
+
+/**
+ * Command handler, called when the payload matches the command name
+ */
+typedef void (*command_handler_t)(void);
+
+typedef struct
+{
+    const char *name;
+    command_handler_t handler;
+} command_t;
+
+/**
+ * Perfect-hash lookup table over a fixed set of command names.
+ * The constructor searches for a hash seed that puts every name in its own
+ * slot, so a lookup is one hash, one slot read and one memcmp. Declare tables
+ * constexpr and static_assert is_perfect() so duplicate names fail the build.
+ */
+template <size_t N>
+class CommandTable
+{
+public:
+    constexpr CommandTable(const command_t (&commands)[N])
+        : m_commands(), m_lengths(), m_slots(), m_seed(NO_SEED)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            m_commands[i] = commands[i];
+            m_lengths[i] = const_strlen(commands[i].name);
+        }
+
+        for (uint32_t seed = 0; seed < MAX_SEED; seed++)
+        {
+            if (try_seed(seed))
+            {
+                m_seed = seed;
+                break;
+            }
+        }
+    }
+
+    /**
+     * @return true if every command name owns a unique slot
+     */
+    constexpr bool is_perfect() const
+    {
+        return m_seed != NO_SEED;
+    }
+
+    /**
+     * Look up a command by name
+     * @param name Payload to match (need not be null-terminated)
+     * @param len Length of name
+     * @return Matching command or NULL
+     */
+    const command_t *find(const char *name, size_t len) const
+    {
+        int8_t idx = m_slots[str_hash(name, len, m_seed) & (SLOTS - 1)];
+        if (idx < 0 || m_lengths[idx] != len || memcmp(m_commands[idx].name, name, len) != 0)
+            return NULL;
+        return &m_commands[idx];
+    }
+
+    /**
+     * Look up a command and run its handler
+     * @return true if a command matched
+     */
+    bool dispatch(const char *name, size_t len) const
+    {
+        const command_t *cmd = find(name, len);
+        if (cmd == NULL)
+            return false;
+        cmd->handler();
+        return true;
+    }
+
+private:
+    static constexpr uint32_t NO_SEED = 0xFFFFFFFFu;
+    static constexpr uint32_t MAX_SEED = 256;
+
+    static constexpr size_t slot_count()
+    {
+        size_t slots = 1;
+        while (slots < N * 2)
+            slots <<= 1;
+        return slots;
+    }
+    static constexpr size_t SLOTS = slot_count();
+    static_assert(N < 128, "Command table too large for int8_t slots");
+
+    constexpr bool try_seed(uint32_t seed)
+    {
+        for (size_t s = 0; s < SLOTS; s++)
+            m_slots[s] = -1;
+
+        for (size_t i = 0; i < N; i++)
+        {
+            size_t slot = str_hash(m_commands[i].name, m_lengths[i], seed) & (SLOTS - 1);
+            if (m_slots[slot] >= 0)
+                return false;
+            m_slots[slot] = (int8_t)i;
+        }
+        return true;
+    }
+
+    command_t m_commands[N];
+    size_t m_lengths[N];
+    int8_t m_slots[SLOTS];
+    uint32_t m_seed;
+};
+
+#endif // COMMAND_TABLE_H
@@ -0,0 +1,79 @@
+#ifndef CUE_SCHEDULER_H
+#define CUE_SCHEDULER_H
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Cues that can be armed at once
+#define CUE_MAX_PENDING 4
+#define CUE_NAME_MAX 24
+
+// The timer wakes the cue task this early and the task spins to the exact
+// microsecond, hiding task switch latency
+#define CUE_WAKE_EARLY_US 2000
+// Cues arriving later than this are reported as missed instead of played
+#define CUE_LATE_TOLERANCE_MS 50
+// Cues further ahead than this are rejected
+#define CUE_MAX_LEAD_MS 60000
+// How long the fire callback may wait for a cue's effect to start
+#define CUE_START_TIMEOUT_MS 50
+
+#define CUE_TASK_PRIORITY 10 // Above the MQTT tasks so cues are not held up
+#define CUE_TASK_STACK_SIZE 3072
+
+  /**
+   * Plays a cue by name
+   * @param started_us Set to the local time its effect actually started
+   * @return ESP_OK once started, ESP_ERR_TIMEOUT if it did not start within
+   *         CUE_START_TIMEOUT_MS, ESP_ERR_NOT_FOUND if the cue is unknown,
+   *         else the cue was refused (e.g. a countdown is already running)
+   */
+  typedef esp_err_t (*cue_fire_t)(const char *cue, size_t len, int64_t *started_us);
+
+  /**
+   * Outcome of a scheduled cue, as reported to the server
+   */
+  typedef enum
+  {
+    CUE_FIRED,    // Played on time
+    CUE_LATE,     // Arrived after its time, not played
+    CUE_UNSYNCED, // No clock estimate, played on arrival
+    CUE_UNKNOWN,  // fire callback did not know the cue
+    CUE_REJECTED, // Too far ahead, no free slot, or refused when due
+  } cue_result_t;
+
+  /**
+   * Start the cue scheduler and listen for MQTT_TOPIC_CUE
+   * @param fire Called from the cue task when a cue is due
+   * @return ESP_OK on success
+   */
+  esp_err_t cue_scheduler_init(cue_fire_t fire);
+
+  /**
+   * Arm a cue at a server time
+   * @param id Server-chosen cue ID echoed in the report
+   * @param cue Cue name passed to the fire callback
+   * @param len Length of cue
+   * @param server_us Server time in microseconds to play it at
+   * @return ESP_OK if armed, ESP_ERR_NO_MEM if no slot is free, ESP_ERR_INVALID_ARG if too far ahead
+   */
+  esp_err_t cue_schedule(uint32_t id, const char *cue, size_t len, int64_t server_us);
+
+  /**
+   * Cancel every armed cue without reporting it
+   * Called on an MQTT disconnect and when a mode that flushes on exit ends.
+   */
+  void cue_cancel_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUE_SCHEDULER_H
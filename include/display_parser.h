@@ -0,0 +1,49 @@
+#ifndef DISPLAY_PARSER_H
+#define DISPLAY_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "lcd_manager.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Deepest object/array nesting accepted in a display message
+#define DISPLAY_PARSER_MAX_DEPTH 8
+
+  /**
+   * Result of parsing a game/display message
+   */
+  typedef struct
+  {
+    lcd_frame_t frame;   // Text to show, valid if has_text
+    bool has_text;       // line1/line2 or message/msg was present
+    bool has_buttons;    // buttons array was present
+    uint8_t button_mask; // button_active_mask_t bits, valid if has_buttons
+  } display_update_t;
+
+  /**
+ * Parse a display message without allocating
+ * Schema: {"line1":"..", "line2":"..", "buttons":[1,2,3]}
+ * or {"message":".."} / {"msg":".."} for a single line.
+ * Keys match case-insensitively and the first match wins, as with
+ * cJSON_GetObjectItem. Strings are decoded straight into the LCD rows and
+ * truncated to LCD_COLS; unknown keys are skipped. The whole document is
+ * validated in one pass.
+ *
+ * @param json Message payload (need not be null-terminated)
+ * @param len Length of json
+ * @param out Parsed update
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the JSON is malformed
+ */
+  esp_err_t display_parse(const char *json, size_t len, display_update_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DISPLAY_PARSER_H
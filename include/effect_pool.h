@@ -0,0 +1,101 @@
+#ifndef EFFECT_POOL_H
+#define EFFECT_POOL_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Jobs waiting per channel
+#define EFFECT_QUEUE_LENGTH 4
+
+#define EFFECT_TASK_PRIORITY 5
+#define EFFECT_TASK_STACK_SIZE 2560
+
+  /**
+   * Each channel has its own worker, so effects on one channel run one at a
+   * time and never overlap
+   */
+  typedef enum
+  {
+    EFFECT_CHANNEL_SOUND,    // Buzzer sounds and press tones
+    EFFECT_CHANNEL_SEQUENCE, // Multi-second LED/LCD sequences
+    EFFECT_CHANNEL_COUNT
+  } effect_channel_t;
+
+  /**
+   * What to do with the channel's current and queued effects
+   */
+  typedef enum
+  {
+    EFFECT_QUEUE,   // Run after everything already on the channel
+    EFFECT_REPLACE, // Cancel the running and queued effects, then run
+    EFFECT_IF_IDLE  // Run only if nothing is running or queued
+  } effect_policy_t;
+
+  typedef void (*effect_fn_t)(void);
+
+  typedef struct
+  {
+    uint32_t posted;
+    uint32_t completed; // Ran to the end, or returned early after a cancel
+    uint32_t cancelled; // Cancelled before or while running
+    uint32_t rejected;  // EFFECT_IF_IDLE while busy, or queue full
+  } effect_stats_t;
+
+  /**
+   * Create the workers and their queues (statically allocated)
+   * @return ESP_OK on success
+   */
+  esp_err_t effect_pool_init(void);
+
+  /**
+   * Queue an effect
+   * Safe from any task; never blocks.
+   * @return ESP_OK if queued, ESP_ERR_INVALID_STATE if EFFECT_IF_IDLE found
+   *         the channel busy, ESP_ERR_NO_MEM if the queue is full
+   */
+  esp_err_t effect_post(effect_channel_t channel, effect_fn_t fn, effect_policy_t policy);
+
+  /**
+   * Queue an effect and block until its worker starts it
+   * For callers that report when an effect really began, like cues. Uses the
+   * calling task's notification value.
+   * @param started_us Set to the esp_timer time the effect started
+   * @return ESP_OK once started, ESP_ERR_TIMEOUT if it did not start in time
+   *         (or was replaced first), else as effect_post()
+   */
+  esp_err_t effect_post_wait(effect_channel_t channel, effect_fn_t fn, effect_policy_t policy,
+                             uint32_t timeout_ms, int64_t *started_us);
+
+  /**
+   * Cancel the running and queued effects on a channel
+   */
+  void effect_cancel(effect_channel_t channel);
+
+  /**
+   * @return true if the calling effect has been cancelled (false outside a worker)
+   */
+  bool effect_cancelled(void);
+
+  /**
+   * Sleep inside an effect, waking early on cancel
+   * Outside a worker this is a plain vTaskDelay.
+   * @return false if the effect was cancelled and should return
+   */
+  bool effect_sleep_ms(uint32_t ms);
+
+  /**
+   * Get a channel's counters
+   */
+  void effect_get_stats(effect_channel_t channel, effect_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EFFECT_POOL_H
@@ -0,0 +1,107 @@
+#ifndef GAME_MODE_H
+#define GAME_MODE_H
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "effect_pool.h"
+#include "wifi_manager.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Transitions kept for game_mode_get_transitions()
+#define GAME_MODE_HISTORY 8
+
+  /**
+   * Modes driven by game/status. Unknown statuses select GAME_MODE_BOARD.
+   */
+  typedef enum
+  {
+    GAME_MODE_BOARD,    // Normal board play
+    GAME_MODE_WAITING,  // Lobby, between games
+    GAME_MODE_MINIGAME, // Timed button minigame
+    GAME_MODE_REACTION, // Reaction rounds
+    GAME_MODE_COUNT
+  } game_mode_t;
+
+  /**
+   * Everything a mode sets on entry
+   */
+  typedef struct
+  {
+    const char *name;
+    uint32_t debounce_ms;
+    bool set_mask;          // Apply button_mask on entry, otherwise keep the display's mask
+    uint8_t button_mask;
+    bool press_tones;       // Play a local tone on each press
+    bool flush_on_exit;     // Drop queued presses and stop sequences when leaving for another mode
+    wifi_latency_profile_t wifi_profile;
+    esp_log_level_t log_level; // Applied to every tag; logging over UART costs ms per line
+    effect_fn_t enter_sound; // Posted to EFFECT_CHANNEL_SOUND after the profile is applied
+  } game_mode_profile_t;
+
+  typedef struct
+  {
+    game_mode_t from;
+    game_mode_t to;
+    int64_t at_us;     // esp_timer time of the status message
+    uint32_t apply_us; // Time taken to apply the profile, excluding enter_sound
+  } game_mode_transition_t;
+
+  /**
+   * Apply the BOARD profile
+   * @return ESP_OK on success
+   */
+  esp_err_t game_mode_init(void);
+
+  /**
+   * Enter the mode named by a game/status payload
+   * @param status Status name (need not be null-terminated)
+   * @param len Length of status
+   */
+  void game_mode_handle_status(const char *status, int len);
+
+  /**
+   * Enter a mode and apply its profile
+   * Transitions are serialised; re-entering the current mode reapplies it.
+   * @return ESP_OK on success
+   */
+  esp_err_t game_mode_enter(game_mode_t mode);
+
+  /**
+   * Get the current mode
+   */
+  game_mode_t game_mode_get(void);
+
+  /**
+   * Get the current mode's profile (never NULL)
+   */
+  const game_mode_profile_t *game_mode_profile(void);
+
+  /**
+   * Copy the most recent transitions, newest first
+   * @param out Receives up to max transitions
+   * @param max Capacity of out
+   * @return Number copied
+   */
+  int game_mode_get_transitions(game_mode_transition_t *out, int max);
+
+  /**
+   * Keep the radio on one latency profile whatever the mode
+   */
+  void game_mode_pin_wifi_profile(wifi_latency_profile_t profile);
+
+  /**
+   * Let the mode choose the radio latency profile again
+   */
+  void game_mode_unpin_wifi_profile(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GAME_MODE_H
@@ -0,0 +1,61 @@
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Counting needs CONFIG_HEAP_USE_HOOKS; without it the stats stay at zero.
+// 1: abort on the first allocation a firmware task makes after boot
+#define HEAP_GUARD_ABORT 0
+
+  /**
+   * Heap use since heap_guard_arm()
+   * Firmware tasks are the ones this code creates, plus "main". Everything
+   * else (Wi-Fi, lwIP, esp-mqtt, esp_timer) is counted only in the totals,
+   * as are library calls a firmware task brackets with heap_guard_pause().
+   */
+  typedef struct
+  {
+    bool armed;
+    uint32_t allocs;          // All tasks and ISRs
+    uint32_t frees;
+    uint32_t bytes;           // Total requested
+    uint32_t firmware_allocs; // From firmware tasks
+    uint32_t firmware_bytes;
+    const char *last_task;    // Firmware task of the latest allocation, or NULL
+    uint32_t last_size;
+  } heap_guard_stats_t;
+
+  /**
+   * Start counting; call once boot is done and every firmware task exists
+   */
+  void heap_guard_arm(void);
+
+  /**
+   * Count the calling task's allocations as library ones until
+   * heap_guard_resume(). For calls that allocate by design, such as the
+   * esp-mqtt outbox entry behind every QoS 1 publish. Calls nest.
+   */
+  void heap_guard_pause(void);
+
+  /**
+   * End the matching heap_guard_pause()
+   */
+  void heap_guard_resume(void);
+
+  /**
+   * Get the counters
+   */
+  void heap_guard_get_stats(heap_guard_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEAP_GUARD_H
@@ -0,0 +1,50 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Bytes available to the cJSON tree of one message. A node is 40 bytes plus
+// its key and string value; larger trees fall back to the heap.
+#define JSON_ARENA_SIZE 2048
+
+  typedef struct
+  {
+    uint32_t size;       // JSON_ARENA_SIZE
+    uint32_t high_water; // Most bytes one message has used
+    uint32_t overflows;  // Allocations that did not fit and went to the heap
+    uint32_t messages;   // Arena sessions run
+  } json_arena_stats_t;
+
+  /**
+   * Route cJSON allocations through the arena (cJSON_InitHooks)
+   * Call once, before any cJSON use.
+   */
+  void json_arena_init(void);
+
+  /**
+   * Give the arena to the calling task until json_arena_end()
+   * cJSON calls from other tasks meanwhile use the heap.
+   */
+  void json_arena_begin(void);
+
+  /**
+   * Release everything allocated since json_arena_begin() in O(1)
+   * Every cJSON tree parsed in between must already be deleted.
+   */
+  void json_arena_end(void);
+
+  /**
+   * Get the arena counters
+   */
+  void json_arena_get_stats(json_arena_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_ARENA_H
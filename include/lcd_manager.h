@@ -13,6 +13,14 @@ extern "C"
 #define LCD_COLS 16
 #define LCD_ROWS 2
 
+  /**
+   * Full-screen text, one null-terminated string per row
+   */
+  typedef struct
+  {
+    char lines[LCD_ROWS][LCD_COLS + 1];
+  } lcd_frame_t;
+
   /**
  * Initialize the LCD display
  * Must be called before any other LCD functions
@@ -81,6 +89,15 @@ extern "C"
  */
   void lcd_show_message(const char *line1, const char *line2);
 
+  /**
+ * Display a full frame
+ * Only rows that differ from what is on screen are rewritten, padded with
+ * spaces, so unchanged frames cost nothing and there is no clear flicker.
+ *
+ * @param frame Frame to show
+ */
+  void lcd_show_frame(const lcd_frame_t *frame);
+
   /**
  * Turn display on/off
  * 
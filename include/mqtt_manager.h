@@ -3,6 +3,7 @@
 
 #include "esp_err.h"
 #include "mqtt_client.h"
+#include "wire_format.h"
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -17,41 +18,329 @@ extern "C"
 #define MQTT_TOPIC_SOUND "game/sound"
 
 #define MQTT_TOPIC_BUTTON "base/button"
+#define MQTT_TOPIC_ACK "game/ack"
+#define MQTT_TOPIC_CONNECTION "game/connection"
+
+// Wire format handshake: the device offers its encodings on connect and the
+// server answers with the topics that should use binary, e.g.
+// {"binary":["button","ack","display"]}. Until then everything is JSON.
+#define MQTT_TOPIC_CAPS "base/caps"
+#define MQTT_TOPIC_CAPS_REPLY "game/caps"
+
+// Cumulative button acks: {"session":<id>,"seq":<n>} confirms every event of
+// that session up to and including seq. Enabled when the caps reply carries
+// "acks":true; otherwise button events are fire-and-forget.
+#define MQTT_TOPIC_BUTTON_ACK "game/button_ack"
+
+// Clock sync: the device sends {"t0":<local_us>} and the server echoes it as
+// {"t0":..,"t1":<server rx us>,"t2":<server tx us>}
+#define MQTT_TOPIC_TIME_PING "base/time/ping"
+#define MQTT_TOPIC_TIME_PONG "game/time/pong"
+
+// Scheduled cues: {"id":<n>,"cue":"SIGNAL","at":<server us>} plays a sound
+// command at a server time; the outcome is reported on MQTT_TOPIC_CUE_REPORT
+#define MQTT_TOPIC_CUE "game/cue"
+#define MQTT_TOPIC_CUE_REPORT "base/cue/report"
+
+// Reaction rounds: {"round":<n>,"timeout_ms":<ms>,"at":<server us>} arms a
+// round measured on the device; one result per round goes to MQTT_TOPIC_REACTION_RESULT
+#define MQTT_TOPIC_REACTION "game/reaction"
+#define MQTT_TOPIC_REACTION_RESULT "base/reaction"
+
+// Health snapshots from the telemetry module, and their configuration
+#define MQTT_TOPIC_TELEMETRY "base/telemetry"
+#define MQTT_TOPIC_TELEMETRY_CONFIG "game/telemetry"
+
+// Pins a radio latency profile (LOW_LATENCY, BALANCED, POWER_SAVE) or AUTO
+#define MQTT_TOPIC_WIFI_PROFILE "game/wifi_profile"
+
+// CPU profiler reports, and the switch that turns it on
+#define MQTT_TOPIC_PROFILE "base/profile"
+#define MQTT_TOPIC_PROFILER_CONFIG "game/profiler"
+
+// Binary trace dumps (16-byte records), and START/STOP/CLEAR/DUMP/DUMP_UART
+#define MQTT_TOPIC_TRACE "base/trace"
+#define MQTT_TOPIC_TRACE_CONFIG "game/trace"
+
+// MQTT 5 is used when enabled in menuconfig (CONFIG_MQTT_PROTOCOL_5). Button
+// events then go out with a topic alias and time pings expire instead of
+// queueing. Session and seq can also be sent as user properties for brokers
+// or bridges that dedupe without parsing the payload; they cost ~30 B per
+// event, more than the alias saves, so they are off by default.
+#define MQTT_ALIAS_BUTTON 1
+#define MQTT_V5_TOPIC_ALIAS_MAX 8 // Aliases the broker may use towards us
+#define MQTT_V5_USER_PROPERTIES 0
+#define MQTT_PING_EXPIRY_S 1
+
+// Per-base namespacing: every topic gets the base ID after its first level,
+// so "game/display" is really "game/<id>/display" and "base/button" is
+// "base/<id>/button". The ID comes from NVS ("config"/"base_id") or the MAC.
+// Messages on the broadcast ID ("game/all/display") reach every base.
+#define MQTT_NAMESPACE_TOPICS 1
+#define MQTT_BROADCAST_ID "all"
+#define MQTT_BASE_ID_MAX_LEN 16
+#define MQTT_FILTER_MAX_LEN 64
+
+// Persistent session: the client ID is derived from the base ID and the broker
+// keeps subscriptions and queued QoS 1 messages across short disconnects
+#define MQTT_PERSISTENT_SESSION 1
+#define MQTT_CLIENT_ID_PREFIX "base-"
+#define MQTT_SESSION_EXPIRY_S 300 // MQTT 5 only; 3.1.1 brokers keep sessions until cleaned
+#define MQTT_RECONNECT_TIMEOUT_MS 1000
+
+// Receive limits for messages split across several MQTT_EVENT_DATA events
+#define MQTT_TOPIC_MAX_LEN 128
+#define MQTT_RX_BUFFER_SIZE 8192
+
+// Worker pipeline: received messages are queued in a ring buffer and handled
+// by a dedicated task so slow handlers never block the esp-mqtt client task.
+// A no-split ring holds items up to half its size, so size it for two maximum messages.
+#define MQTT_RX_RING_SIZE (2 * (MQTT_RX_BUFFER_SIZE + MQTT_TOPIC_MAX_LEN + 64))
+#define MQTT_WORKER_PRIORITY 4 // Below the esp-mqtt client task (5)
+#define MQTT_WORKER_STACK_SIZE 4096
+// How long a new connection waits for ring space to queue its CONNECTED/caps publishes
+#define MQTT_CONNECT_QUEUE_WAIT_MS 500
+// How long a connection waits for the server's capability reply before
+// assuming a server that does not answer (JSON, no button acks)
+#define MQTT_CAPS_REPLY_TIMEOUT_MS 2000
+#define MQTT_MAX_CONNECTION_CALLBACKS 4
+
+// Topic router capacity
+#define MQTT_MAX_ROUTES 16
+#define MQTT_ROUTE_SLOTS 32 // Hash slots, power of two
 
    /**
-     * Callback function type for incoming MQTT messages
+     * Handler type for incoming MQTT messages
+     * Topic and payload are views into MQTT buffers: they are NOT null-terminated
+     * and are only valid for the duration of the call.
      * @param topic The topic the message was received on
-     * @param payload The message payload (null-terminated)
+     * @param topic_len Length of topic
+     * @param payload The message payload
      * @param payload_len Length of payload
+     * @param ctx Context pointer given at registration
+     */
+   typedef void (*mqtt_topic_handler_t)(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx);
+
+   /**
+     * Per-route processing statistics
+     */
+   typedef struct
+   {
+      uint32_t messages;    // Messages handled
+      uint64_t total_us;    // Total time spent in the handler
+      uint32_t max_us;      // Slowest single message
+      uint32_t over_budget; // Messages that exceeded the route's budget
+   } mqtt_route_stats_t;
+
+   /**
+     * Worker queue statistics and watermarks
+     */
+   typedef struct
+   {
+      uint32_t queued;              // Messages handed to the worker
+      uint32_t processed;           // Messages the worker has finished
+      uint32_t dropped;             // Messages lost because the ring was full or too small
+      uint32_t pending_high_water;  // Most messages waiting at once
+      size_t free_bytes_low_water;  // Least free ring space seen
+      uint32_t max_queue_wait_us;   // Longest time a message waited for the worker
+   } mqtt_worker_stats_t;
+
+   /**
+     * Reconnect timing, from the MQTT disconnect event
+     */
+   typedef struct
+   {
+      uint32_t reconnects;              // Connections after the first
+      uint32_t sessions_resumed;        // Reconnects where the broker still had our session
+      uint32_t last_connect_us;         // Disconnect to CONNACK
+      uint32_t last_first_message_us;   // Disconnect to the first message received
+      uint32_t max_first_message_us;    // Worst disconnect to first message seen
+   } mqtt_reconnect_stats_t;
+
+   /**
+     * Called on the esp-mqtt task whenever the broker connection comes up or drops
      */
-   typedef void (*mqtt_message_callback_t)(const char *topic, const char *payload, int payload_len);
+   typedef void (*mqtt_connection_cb_t)(bool connected);
 
    /**
-     * Initialize MQTT client and start connection
+     * Initialize the MQTT client without connecting
+     * Handlers can be registered before or after; call mqtt_manager_start()
+     * once the network is up.
      * @return ESP_OK on success
      */
    esp_err_t mqtt_manager_init(void);
 
    /**
-     * Set callback for incoming MQTT messages
-     * @param callback Function to call when message is received
+     * Start connecting to the broker. Safe to call more than once.
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE before mqtt_manager_init()
+     */
+   esp_err_t mqtt_manager_start(void);
+
+   /**
+     * Add a connection callback
+     * @param cb Callback
+     * @return ESP_OK, or ESP_ERR_NO_MEM with MQTT_MAX_CONNECTION_CALLBACKS already added
+     */
+   esp_err_t mqtt_add_connection_callback(mqtt_connection_cb_t cb);
+
+   /**
+     * Route a topic filter to a handler and subscribe to it.
+     * Filters may use MQTT '+' and '#' wildcards. Every matching route is called.
+     * Handlers run on the MQTT worker task, not the esp-mqtt client task.
+     * The filter is namespaced with the base ID (see MQTT_NAMESPACE_TOPICS) and
+     * handlers receive the namespaced topic, also for broadcast messages.
+     * @param topic_filter Topic or wildcard filter, at most MQTT_FILTER_MAX_LEN - 1 after namespacing
+     * @param qos Subscription QoS
+     * @param handler Function to call for matching messages
+     * @param ctx Passed through to the handler
+     * @param budget_ms Expected worst-case handling time per message, 0 for none.
+     *                  Overruns are logged and counted in the route statistics.
+     * @return ESP_OK on success, ESP_ERR_NO_MEM if the route table is full
+     */
+   esp_err_t mqtt_register_handler(const char *topic_filter, int qos, mqtt_topic_handler_t handler, void *ctx, uint32_t budget_ms);
+
+   /**
+     * Get the number of registered routes
+     */
+   int mqtt_get_route_count(void);
+
+   /**
+     * Get processing statistics for a route
+     * @param index Route index (0 .. mqtt_get_route_count() - 1)
+     * @param filter_out Optional, receives the route's topic filter
+     * @param stats_out Receives a snapshot of the statistics
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a bad index
+     */
+   esp_err_t mqtt_get_route_stats(int index, const char **filter_out, mqtt_route_stats_t *stats_out);
+
+   /**
+     * Get worker queue statistics
+     * @param stats_out Receives a snapshot of the statistics
+     */
+   void mqtt_get_worker_stats(mqtt_worker_stats_t *stats_out);
+
+   /**
+     * Get reconnect timing
+     * @param stats_out Receives a snapshot of the statistics
+     */
+   void mqtt_get_reconnect_stats(mqtt_reconnect_stats_t *stats_out);
+
+   /**
+     * Get the MQTT client ID ("base-" followed by the base ID)
      */
-   void mqtt_set_message_callback(mqtt_message_callback_t callback);
+   const char *mqtt_get_client_id(void);
+
+   /**
+     * Get the base ID used in topics
+     * Read from NVS on first use (NVS must be initialized by then), otherwise
+     * the last three MAC bytes in hex.
+     */
+   const char *mqtt_get_base_id(void);
+
+   /**
+     * Store a base ID in NVS, used from the next boot
+     * @param base_id 1..MQTT_BASE_ID_MAX_LEN-1 characters, no '/', '+' or '#'
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unusable ID
+     */
+   esp_err_t mqtt_set_base_id(const char *base_id);
 
    /**
      * Publish a button press event
+     * Prefer outbox_push(), which also covers disconnected periods.
      * @param player_id Player identifier (e.g., "meeple_1")
      * @param button Button number (1, 2, or 3)
-     * @param timestamp_ms Timestamp in milliseconds
-     * @return ESP_OK on success
+     * @param session Per-boot session ID
+     * @param seq Sequence number assigned at capture
+     * @param timestamp_ms Capture timestamp in milliseconds, server time when error_ms >= 0
+     * @param error_ms Clock error bound in milliseconds, -1 if timestamp_ms is time since boot
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
+     */
+   esp_err_t mqtt_publish_button(const char *player_id, uint8_t button, uint32_t session, uint32_t seq, int64_t timestamp_ms, int32_t error_ms);
+
+   /**
+     * Publish a clock sync ping
+     * @param t0_us Local send time in microseconds
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
+     */
+   esp_err_t mqtt_publish_time_ping(int64_t t0_us);
+
+   /**
+     * Publish a cue report
+     * @param payload JSON report built by the cue scheduler
+     * @param len Length of payload
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
+     */
+   esp_err_t mqtt_publish_cue_report(const char *payload, int len);
+
+   /**
+     * Publish a reaction round result
+     * @param payload JSON result built by the reaction mode
+     * @param len Length of payload
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
+     */
+   esp_err_t mqtt_publish_reaction_result(const char *payload, int len);
+
+   /**
+     * Publish a telemetry snapshot
+     * @param payload JSON snapshot built by the telemetry module
+     * @param len Length of payload
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
+     */
+   esp_err_t mqtt_publish_telemetry(const char *payload, int len);
+
+   /**
+     * Publish a CPU profile report
+     * @param payload JSON report built by the profiler
+     * @param len Length of payload
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
      */
-   esp_err_t mqtt_publish_button(const char *player_id, uint8_t button, int64_t timestamp_ms);
+   esp_err_t mqtt_publish_profile(const char *payload, int len);
+
+   /**
+     * Publish a chunk of trace records
+     * @param data Raw trace_record_t array
+     * @param len Length of data in bytes
+     * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
+     */
+   esp_err_t mqtt_publish_trace(const uint8_t *data, int len);
+
+   /**
+     * Get the number of bytes waiting in the esp-mqtt outbox (unacked QoS 1/2)
+     */
+   int mqtt_get_outbox_size(void);
 
    /**
      * Publish ACK for display message
      */
    void mqtt_publish_ack(void);
 
+   /**
+     * Check whether a topic was negotiated to use the binary wire format
+     * @param topic Topic to check
+     * @return true for binary, false for JSON
+     */
+   bool mqtt_wire_is_binary(wire_topic_t topic);
+
+   /**
+     * Get the time the message being handled arrived from the broker
+     * Only meaningful inside a handler; excludes time spent in the worker queue.
+     * @return esp_timer time in microseconds
+     */
+   int64_t mqtt_message_rx_time_us(void);
+
+   /**
+     * Check whether the server acks button events on MQTT_TOPIC_BUTTON_ACK
+     * @return true once the capability reply enabled acks
+     */
+   bool mqtt_button_acks_enabled(void);
+
+   /**
+     * Check whether the capability reply for this connection is still due
+     * Until it arrives the ack mode is unknown, so senders that need it wait.
+     * @return true from CONNECTED until the reply or MQTT_CAPS_REPLY_TIMEOUT_MS
+     */
+   bool mqtt_caps_pending(void);
+
    /**
      * Check if MQTT is connected
      * @return true if connected
@@ -0,0 +1,58 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Loads are computed over the last PROFILER_WINDOW_SAMPLES samples (one per
+// telemetry tick) and a report is published every time the window turns over
+#define PROFILER_WINDOW_SAMPLES 5
+// Tasks tracked per sample; more than this and the sample is skipped
+#define PROFILER_MAX_TASKS 24
+// Tasks below this share (tenths of a percent of one core) are left out of reports
+#define PROFILER_MIN_SHARE_X10 1
+
+  /**
+   * Listen for profiler settings on MQTT_TOPIC_PROFILER_CONFIG
+   * The profiler starts disabled.
+   * @return ESP_OK on success
+   */
+  esp_err_t profiler_init(void);
+
+  /**
+   * Switch the profiler on or off
+   * Buffers are allocated on the next sample after enabling and freed on the
+   * next sample after disabling.
+   * @return ESP_OK, or ESP_ERR_NOT_SUPPORTED if the kernel was built without run-time stats
+   */
+  esp_err_t profiler_set_enabled(bool enabled);
+
+  /**
+   * Check whether the profiler is running
+   */
+  bool profiler_is_enabled(void);
+
+  /**
+   * Take one sample, and publish a report once per window
+   * Called from the telemetry task; returns at once while disabled.
+   */
+  void profiler_sample(void);
+
+  /**
+   * Get a core's utilisation over the last window
+   * @param core Core number
+   * @return Percent busy, or -1 while disabled or before the first full window
+   */
+  int profiler_get_core_load(int core);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,69 @@
+#ifndef REACTION_MODE_H
+#define REACTION_MODE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Players measured per round (buttons 1..REACTION_PLAYERS)
+#define REACTION_PLAYERS 3
+#define REACTION_DEFAULT_TIMEOUT_MS 3000
+// A round whose stimulus never comes is abandoned after this long
+#define REACTION_MAX_ARMED_MS 65000
+
+  /**
+   * Called when a round is armed, from whichever task armed it
+   * The owner of the main loop should start calling reaction_poll().
+   */
+  typedef void (*reaction_wake_t)(void);
+
+  /**
+   * Listen for reaction rounds on MQTT_TOPIC_REACTION
+   * @param wake Called whenever a round is armed
+   * @return ESP_OK on success
+   */
+  esp_err_t reaction_init(reaction_wake_t wake);
+
+  /**
+   * Arm a round: presses from now until the stimulus are false starts
+   * @param round_id Server round ID echoed in the result
+   * @param timeout_ms How long players have after the stimulus
+   */
+  void reaction_arm(uint32_t round_id, uint32_t timeout_ms);
+
+  /**
+   * Emit the stimulus (LEDs and buzzer) and start timing
+   * Registered as the REACTION sound command so it can be scheduled as a cue.
+   */
+  void reaction_fire_stimulus(void);
+
+  /**
+   * Feed a button press to the current round
+   * @param btn Button ID (1, 2, 3)
+   * @param time_us esp_timer time of the press, as captured in the interrupt
+   * @return true if a round consumed the press (it must not be published)
+   */
+  bool reaction_handle_press(uint8_t btn, int64_t time_us);
+
+  /**
+   * Finish the round once every player is in or time is up, and publish it
+   * Call regularly from the main loop after a wake.
+   * @return true while a round is open or its result is still unpublished
+   */
+  bool reaction_poll(void);
+
+  /**
+   * Check whether a round is armed or running
+   */
+  bool reaction_is_active(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REACTION_MODE_H
@@ -0,0 +1,83 @@
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "freertos/ringbuf.h"
+
+// C++ only: used from the firmware .cpp files
+
+// 1: firmware tasks, queues, mutexes, event groups and ring buffers live in
+// .bss instead of the heap. Follows CONFIG_STATIC_MEMORY_MODE (src/Kconfig.projbuild).
+#ifndef STATIC_MEMORY_MODE
+#if CONFIG_STATIC_MEMORY_MODE
+#define STATIC_MEMORY_MODE 1
+#else
+#define STATIC_MEMORY_MODE 0
+#endif
+#endif
+
+/*
+ * Declare storage at file scope with STATIC_*_BUFFERS(name, ...) and create
+ * the object with the matching STATIC_*_CREATE(name, ...). The buffers
+ * compile away when STATIC_MEMORY_MODE is 0. Every create returns the handle,
+ * or NULL on failure, in both modes.
+ */
+#if STATIC_MEMORY_MODE
+
+#define STATIC_TASK_BUFFERS(name, stack_size) \
+    static StaticTask_t name##_tcb;             \
+    static StackType_t name##_stack[stack_size]
+#define STATIC_TASK_CREATE(name, fn, task_name, stack_size, arg, priority) \
+    xTaskCreateStatic(fn, task_name, stack_size, arg, priority, name##_stack, &name##_tcb)
+
+#define STATIC_QUEUE_BUFFERS(name, length, item_size) \
+    static StaticQueue_t name##_queue;                  \
+    static uint8_t name##_storage[(length) * (item_size)]
+#define STATIC_QUEUE_CREATE(name, length, item_size) \
+    xQueueCreateStatic(length, item_size, name##_storage, &name##_queue)
+
+#define STATIC_MUTEX_BUFFERS(name) static StaticSemaphore_t name##_mutex
+#define STATIC_MUTEX_CREATE(name) xSemaphoreCreateMutexStatic(&name##_mutex)
+
+#define STATIC_EVENT_GROUP_BUFFERS(name) static StaticEventGroup_t name##_group
+#define STATIC_EVENT_GROUP_CREATE(name) xEventGroupCreateStatic(&name##_group)
+
+// Ring buffer storage must be 32-bit aligned
+#define STATIC_RINGBUF_BUFFERS(name, size) \
+    static StaticRingbuffer_t name##_ring;  \
+    alignas(4) static uint8_t name##_storage[size]
+#define STATIC_RINGBUF_CREATE(name, size, type) \
+    xRingbufferCreateStatic(size, type, name##_storage, &name##_ring)
+
+#else
+
+static inline TaskHandle_t static_alloc_task_create(TaskFunction_t fn, const char *name, uint32_t stack_size,
+                                                    void *arg, UBaseType_t priority)
+{
+    TaskHandle_t handle = NULL;
+    return xTaskCreate(fn, name, stack_size, arg, priority, &handle) == pdPASS ? handle : NULL;
+}
+
+#define STATIC_TASK_BUFFERS(name, stack_size) static_assert(true, "")
+#define STATIC_TASK_CREATE(name, fn, task_name, stack_size, arg, priority) \
+    static_alloc_task_create(fn, task_name, stack_size, arg, priority)
+
+#define STATIC_QUEUE_BUFFERS(name, length, item_size) static_assert(true, "")
+#define STATIC_QUEUE_CREATE(name, length, item_size) xQueueCreate(length, item_size)
+
+#define STATIC_MUTEX_BUFFERS(name) static_assert(true, "")
+#define STATIC_MUTEX_CREATE(name) xSemaphoreCreateMutex()
+
+#define STATIC_EVENT_GROUP_BUFFERS(name) static_assert(true, "")
+#define STATIC_EVENT_GROUP_CREATE(name) xEventGroupCreate()
+
+#define STATIC_RINGBUF_BUFFERS(name, size) static_assert(true, "")
+#define STATIC_RINGBUF_CREATE(name, size, type) xRingbufferCreate(size, type)
+
+#endif // STATIC_MEMORY_MODE
+
+#endif // STATIC_ALLOC_H
@@ -0,0 +1,64 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Cheap counters are sampled every TELEMETRY_SAMPLE_MS; a full snapshot is
+// published every interval, or straight away when an alert trips
+#define TELEMETRY_SAMPLE_MS 1000
+#define TELEMETRY_DEFAULT_INTERVAL_MS 30000
+// Minimum gap between two alert snapshots
+#define TELEMETRY_ALERT_HOLDOFF_MS 5000
+
+// Alert thresholds
+#define TELEMETRY_LOW_HEAP_BYTES 16384
+#define TELEMETRY_QUEUE_ALERT_PERCENT 75
+#define TELEMETRY_LOW_STACK_BYTES 256
+
+#define TELEMETRY_TASK_PRIORITY 1
+#define TELEMETRY_TASK_STACK_SIZE 3072
+
+  /**
+   * Reasons a snapshot was published early (bitmask)
+   */
+  typedef enum
+  {
+    TELEMETRY_ALERT_NONE = 0,
+    TELEMETRY_ALERT_LOW_HEAP = (1 << 0),
+    TELEMETRY_ALERT_BUTTON_QUEUE = (1 << 1),
+    TELEMETRY_ALERT_OUTBOX = (1 << 2),
+    TELEMETRY_ALERT_MQTT_WORKER = (1 << 3),
+    TELEMETRY_ALERT_LOW_STACK = (1 << 4),
+    TELEMETRY_ALERT_POOR_LINK = (1 << 5),
+    TELEMETRY_ALERT_HEAP_ALLOC = (1 << 6), // A firmware task used the heap (STATIC_MEMORY_MODE only)
+  } telemetry_alert_t;
+
+  /**
+   * Start sampling and publishing
+   * @return ESP_OK on success
+   */
+  esp_err_t telemetry_init(void);
+
+  /**
+   * Set how often a snapshot is published
+   * @param interval_ms Publish interval, 0 to publish alerts only
+   */
+  void telemetry_set_interval(uint32_t interval_ms);
+
+  /**
+   * Publish a snapshot on the next sample
+   */
+  void telemetry_request_snapshot(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_H
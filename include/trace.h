@@ -0,0 +1,104 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// 0 compiles every TRACE() call out
+#define TRACE_ENABLED 1
+// Records kept; a power of two (16 B each)
+#define TRACE_CAPACITY 512
+// Record from boot, or only after a START on MQTT_TOPIC_TRACE_CONFIG
+#define TRACE_START_ENABLED 1
+// Records per MQTT dump message
+#define TRACE_DUMP_CHUNK 64
+
+  /**
+   * Event IDs. tools/trace_decode.py reads the names and values from this
+   * enum, so keep one "TRACE_<NAME> = <n>," per line. _BEGIN/_END pairs
+   * become duration slices in the timeline.
+   */
+  typedef enum
+  {
+    TRACE_BUTTON_ISR = 1,         // gpio, tick
+    TRACE_BUTTON_EVENT = 2,       // button, tick
+    TRACE_BUTTON_BOUNCE = 3,      // button, ticks since the last press
+    TRACE_BUTTON_MASKED = 4,      // button, mask
+    TRACE_MQTT_RX = 5,            // topic length, payload length
+    TRACE_MQTT_HANDLER_BEGIN = 6, // route, payload length
+    TRACE_MQTT_HANDLER_END = 7,   // route, elapsed us
+    TRACE_DISPLAY = 8,            // payload length
+    TRACE_TONE = 9,               // frequency Hz, duration ms
+    TRACE_EFFECT_BEGIN = 10,      // channel, effect address
+    TRACE_EFFECT_END = 11,        // channel, cancelled
+    TRACE_MODE = 12,              // from, to
+    TRACE_PRESS = 13,             // button, outbox result
+    TRACE_BUTTON_TX = 14,         // button, seq
+    TRACE_MQTT_PUBLISHED = 15,    // msg_id
+  } trace_event_t;
+
+  /**
+   * One event, 16 bytes, little-endian
+   */
+  typedef struct
+  {
+    uint32_t time_us; // esp_timer time, low 32 bits (wraps every 71 min)
+    uint16_t id;      // trace_event_t
+    uint8_t core;
+    uint8_t isr;      // 1 if recorded from an ISR
+    uint32_t arg0;
+    uint32_t arg1;
+  } trace_record_t;
+
+  /**
+   * Register the MQTT_TOPIC_TRACE_CONFIG route
+   * @return ESP_OK on success
+   */
+  esp_err_t trace_init(void);
+
+  /**
+   * Append an event; lock-free and safe from ISRs and either core
+   * Use TRACE() so the call compiles out with TRACE_ENABLED 0.
+   */
+  void trace_record(uint16_t id, uint32_t arg0, uint32_t arg1);
+
+  /**
+   * Start or stop recording
+   */
+  void trace_set_enabled(bool enabled);
+
+  /**
+   * Drop every record
+   */
+  void trace_clear(void);
+
+  /**
+   * Print the ring, oldest first, as "TRACE:<32 hex digits>" lines
+   * Recording pauses while it runs.
+   */
+  void trace_dump_uart(void);
+
+  /**
+   * Publish the ring, oldest first, to MQTT_TOPIC_TRACE in binary chunks
+   * Recording pauses while it runs.
+   * @return ESP_OK on success, ESP_ERR_INVALID_STATE while disconnected
+   */
+  esp_err_t trace_dump_mqtt(void);
+
+#if TRACE_ENABLED
+#define TRACE(id, arg0, arg1) trace_record((id), (uint32_t)(arg0), (uint32_t)(arg1))
+#else
+#define TRACE(id, arg0, arg1) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
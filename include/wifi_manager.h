@@ -3,6 +3,8 @@
 
 #include "esp_err.h"
 #include "esp_event.h"
+#include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -11,8 +13,37 @@ extern "C"
 
 #define WIFI_SSID "Pixel_8983"
 #define WIFI_PASS "#12345678"
+// Consecutive failed connects before the status becomes WIFI_STATUS_FAILED.
+// Retries continue at the maximum backoff.
 #define MAXIMUM_RETRY 5
 
+// Reconnect backoff doubles from the base up to the max, +/- jitter
+#define WIFI_BACKOFF_BASE_MS 250
+#define WIFI_BACKOFF_MAX_MS 30000
+#define WIFI_BACKOFF_JITTER_PERCENT 25
+
+// Link quality: RSSI is sampled on a timer and mapped linearly from BAD (0)
+// to GOOD (100); every disconnect in the window takes PENALTY off the score
+#define WIFI_LINK_SAMPLE_MS 2000
+#define WIFI_LINK_RSSI_GOOD -55
+#define WIFI_LINK_RSSI_BAD -85
+#define WIFI_LINK_DISCONNECT_WINDOW_MS 60000
+#define WIFI_LINK_DISCONNECT_PENALTY 25
+#define WIFI_LINK_SCORE_GOOD 60
+#define WIFI_LINK_SCORE_FAIR 30
+#define WIFI_LINK_MAX_SUBSCRIBERS 4
+
+// The last good AP (BSSID, channel) and IP lease are kept in this NVS namespace
+// so boot can connect without a scan
+#define WIFI_NVS_NAMESPACE "wifi"
+// Reuse the cached lease instead of running DHCP. Saves a DHCP exchange, but
+// assumes the router keeps the lease; leave off unless addresses are reserved.
+#define WIFI_USE_CACHED_IP 0
+
+// Beacons between wake-ups under WIFI_PROFILE_POWER_SAVE. Sent when associating,
+// so it takes effect on the next connect.
+#define WIFI_LISTEN_INTERVAL 3
+
   // WiFi connection status
   typedef enum
   {
@@ -23,7 +54,76 @@ extern "C"
   } wifi_status_t;
 
   /**
- * Initialize and connect to WiFi
+   * Radio power-save settings, fastest first
+   */
+  typedef enum
+  {
+    WIFI_PROFILE_LOW_LATENCY, // No power save: downlink frames arrive at once
+    WIFI_PROFILE_BALANCED,    // Minimum modem sleep, wakes every DTIM (default)
+    WIFI_PROFILE_POWER_SAVE,  // Maximum modem sleep, wakes every WIFI_LISTEN_INTERVAL beacons
+    WIFI_PROFILE_COUNT
+  } wifi_latency_profile_t;
+
+  /**
+   * Coarse link quality, worst first
+   */
+  typedef enum
+  {
+    WIFI_LINK_DOWN,
+    WIFI_LINK_POOR,
+    WIFI_LINK_FAIR,
+    WIFI_LINK_GOOD
+  } wifi_link_level_t;
+
+  typedef struct
+  {
+    uint8_t score;           // 0-100, 0 while disconnected
+    wifi_link_level_t level;
+    int8_t rssi;             // Smoothed RSSI in dBm
+    uint8_t last_reason;     // wifi_err_reason_t of the last disconnect
+    uint32_t disconnects;    // Since boot
+    uint32_t recent_disconnects; // In the last WIFI_LINK_DISCONNECT_WINDOW_MS
+  } wifi_link_quality_t;
+
+  /**
+   * Called on the esp_timer or event loop task when the link level changes
+   * Keep it short: flip a mode or notify a task.
+   */
+  typedef void (*wifi_link_cb_t)(const wifi_link_quality_t *quality, void *ctx);
+
+  /**
+   * Round-trip times measured under one profile
+   */
+  typedef struct
+  {
+    uint32_t samples;
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t max_us;
+  } wifi_rtt_stats_t;
+
+  /**
+   * Connection timing since boot
+   */
+  typedef struct
+  {
+    int64_t start_us;       // esp_wifi_start() called
+    int64_t boot_to_ip_us;  // First IP since power-on, 0 until then
+    bool fast_connect;      // A cached AP was tried first
+    bool fast_connect_ok;   // ...and it worked without a scan
+    bool cached_ip;         // The cached lease was applied instead of DHCP
+    uint32_t full_scans;    // Connects that needed an all-channel scan
+  } wifi_connect_stats_t;
+
+  /**
+ * Initialize WiFi and start connecting in the background
+ * Also initializes NVS. IP_EVENT_STA_GOT_IP is posted once connected.
+ * @return ESP_OK on success
+ */
+  esp_err_t wifi_start_sta(void);
+
+  /**
+ * Initialize and connect to WiFi, blocking until connected
  * @return ESP_OK on success
  */
   esp_err_t wifi_init_sta(void);
@@ -35,13 +135,13 @@ extern "C"
   wifi_status_t wifi_get_status(void);
 
   /**
- * Disconnect from WiFi
+ * Disconnect from WiFi and stop reconnecting until wifi_reconnect()
  * @return ESP_OK on success
  */
   esp_err_t wifi_disconnect(void);
 
   /**
- * Reconnect to WiFi
+ * Reconnect to WiFi now, resetting the backoff
  * @return ESP_OK on success
  */
   esp_err_t wifi_reconnect(void);
@@ -54,6 +154,61 @@ extern "C"
      */
   esp_err_t wifi_get_ip(char *buffer, size_t len);
 
+  /**
+     * Get the signal strength of the current AP
+     * @param rssi_out RSSI in dBm
+     * @return ESP_OK on success, ESP_ERR_WIFI_NOT_CONNECT while not associated
+     */
+  esp_err_t wifi_get_rssi(int8_t *rssi_out);
+
+  /**
+     * Get connection timing since boot
+     * @param stats_out Receives a snapshot of the statistics
+     */
+  void wifi_get_connect_stats(wifi_connect_stats_t *stats_out);
+
+  /**
+     * Get the current link quality
+     * @param quality_out Receives a snapshot
+     */
+  void wifi_get_link_quality(wifi_link_quality_t *quality_out);
+
+  /**
+     * Be told whenever the link level changes
+     * @param cb Callback
+     * @param ctx Passed to the callback
+     * @return ESP_OK, or ESP_ERR_NO_MEM with WIFI_LINK_MAX_SUBSCRIBERS already registered
+     */
+  esp_err_t wifi_link_subscribe(wifi_link_cb_t cb, void *ctx);
+
+  /**
+     * Switch the radio power-save profile
+     * @return ESP_OK on success
+     */
+  esp_err_t wifi_set_latency_profile(wifi_latency_profile_t profile);
+
+  /**
+     * Get the active power-save profile
+     */
+  wifi_latency_profile_t wifi_get_latency_profile(void);
+
+  /**
+     * Get a profile's short name ("low_latency", "balanced", "power_save")
+     */
+  const char *wifi_profile_name(wifi_latency_profile_t profile);
+
+  /**
+     * Record a measured round trip against the active profile
+     * @param rtt_us Round-trip time, excluding time spent on the far end
+     */
+  void wifi_record_rtt(uint32_t rtt_us);
+
+  /**
+     * Get the round-trip times measured under a profile
+     * @param stats_out Receives a snapshot of the statistics
+     */
+  void wifi_get_rtt_stats(wifi_latency_profile_t profile, wifi_rtt_stats_t *stats_out);
+
 #ifdef __cplusplus
 }
 #endif
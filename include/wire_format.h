@@ -0,0 +1,98 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "display_parser.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Binary frames start with a version byte and a type byte.
+// All multi-byte fields are little-endian.
+#define WIRE_VERSION 2
+
+  typedef enum
+  {
+    WIRE_MSG_BUTTON = 1,     // [ver][type][button][err_ms][session:u32][seq:u32][timestamp_ms:i64]
+    WIRE_MSG_ACK = 2,        // [ver][type]
+    WIRE_MSG_DISPLAY = 3,    // [ver][type][flags][mask][len1][line1..][len2][line2..]
+    WIRE_MSG_BUTTON_ACK = 4, // [ver][type][rsvd][rsvd][session:u32][seq:u32]
+  } wire_msg_type_t;
+
+  /**
+   * Topics whose encoding is negotiated at connect time (bitmask)
+   */
+  typedef enum
+  {
+    WIRE_TOPIC_NONE = 0,
+    WIRE_TOPIC_BUTTON = (1 << 0),
+    WIRE_TOPIC_ACK = (1 << 1),
+    WIRE_TOPIC_DISPLAY = (1 << 2),
+  } wire_topic_t;
+
+// Display frame flags
+#define WIRE_DISPLAY_HAS_TEXT (1 << 0)
+#define WIRE_DISPLAY_HAS_BUTTONS (1 << 1)
+
+// Button err_ms saturates below this value, which marks time since boot
+#define WIRE_ERR_UNSYNCED 0xFF
+
+#define WIRE_BUTTON_SIZE 20
+#define WIRE_ACK_SIZE 2
+#define WIRE_BUTTON_ACK_SIZE 12
+
+  /**
+ * Encode a button event
+ * @param buf Output buffer
+ * @param cap Size of buf (at least WIRE_BUTTON_SIZE)
+ * @param button Button number (1, 2, or 3)
+ * @param session Per-boot session ID
+ * @param seq Sequence number
+ * @param timestamp_ms Timestamp in milliseconds
+ * @param error_ms Clock error bound in milliseconds, negative for time since boot
+ * @return Encoded length, 0 if buf is too small
+ */
+  size_t wire_encode_button(uint8_t *buf, size_t cap, uint8_t button, uint32_t session, uint32_t seq, int64_t timestamp_ms, int32_t error_ms);
+
+  /**
+ * Encode a display acknowledgement
+ * @return Encoded length, 0 if buf is too small
+ */
+  size_t wire_encode_ack(uint8_t *buf, size_t cap);
+
+  /**
+ * Decode a display frame
+ * @param buf Frame received on the display topic
+ * @param len Length of buf
+ * @param out Decoded update, same shape as display_parse() produces
+ * @return ESP_OK on success, ESP_ERR_INVALID_VERSION or ESP_ERR_INVALID_SIZE on bad frames
+ */
+  esp_err_t wire_decode_display(const uint8_t *buf, size_t len, display_update_t *out);
+
+  /**
+ * Decode a cumulative button ack
+ * @param buf Frame received on the button ack topic
+ * @param len Length of buf
+ * @param session_out Session the ack refers to
+ * @param seq_out Highest sequence number received by the server
+ * @return ESP_OK on success, ESP_ERR_INVALID_VERSION or ESP_ERR_INVALID_SIZE on bad frames
+ */
+  esp_err_t wire_decode_button_ack(const uint8_t *buf, size_t len, uint32_t *session_out, uint32_t *seq_out);
+
+  /**
+ * Check whether a payload looks like a binary frame rather than JSON
+ */
+  static inline bool wire_is_binary(const char *payload, int len)
+  {
+    return len >= 2 && (uint8_t)payload[0] == WIRE_VERSION;
+  }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WIRE_FORMAT_H
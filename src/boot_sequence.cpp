@@ -0,0 +1,109 @@
+#include "boot_sequence.h"
+#include "wifi_manager.h"
+#include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "BOOT";
+
+static const char *const PHASE_NAMES[BOOT_PHASE_COUNT] = {
+    "app_main", "radio", "peripherals", "services", "ready", "wifi", "mqtt"};
+
+// Marks come from app_main, the event loop task and the esp-mqtt task
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_phase_us[BOOT_PHASE_COUNT];
+static bool s_mqtt_ready = false; // mqtt_manager_init() has run
+static bool s_has_ip = false;
+static bool s_mqtt_started = false;
+
+void boot_mark(boot_phase_t phase)
+{
+    if (phase >= BOOT_PHASE_COUNT)
+        return;
+
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_mux);
+    bool first = s_phase_us[phase] == 0;
+    if (first)
+        s_phase_us[phase] = now;
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (first)
+        ESP_LOGI(TAG, "%-11s %5lld ms", PHASE_NAMES[phase], now / 1000);
+}
+
+int64_t boot_phase_time_us(boot_phase_t phase)
+{
+    if (phase >= BOOT_PHASE_COUNT)
+        return 0;
+
+    taskENTER_CRITICAL(&s_mux);
+    int64_t t = s_phase_us[phase];
+    taskEXIT_CRITICAL(&s_mux);
+    return t;
+}
+
+/**
+ * Start the MQTT client once both the client and an IP exist, whichever
+ * comes last
+ */
+static void maybe_start_mqtt(void)
+{
+    taskENTER_CRITICAL(&s_mux);
+    bool start = s_mqtt_ready && s_has_ip && !s_mqtt_started;
+    if (start)
+        s_mqtt_started = true;
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (start)
+        mqtt_manager_start();
+}
+
+static void on_got_ip(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    boot_mark(BOOT_PHASE_WIFI);
+    taskENTER_CRITICAL(&s_mux);
+    s_has_ip = true;
+    taskEXIT_CRITICAL(&s_mux);
+    maybe_start_mqtt();
+}
+
+static void on_mqtt_connection(bool connected)
+{
+    if (connected)
+    {
+        boot_mark(BOOT_PHASE_MQTT);
+    }
+}
+
+esp_err_t boot_start_network(void)
+{
+    esp_err_t err = wifi_start_sta();
+    if (err != ESP_OK)
+        return err;
+
+    err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &on_got_ip, NULL, NULL);
+    if (err != ESP_OK)
+        return err;
+
+    // Too late for the event only if the AP answered within microseconds
+    if (wifi_get_status() == WIFI_STATUS_CONNECTED)
+        on_got_ip(NULL, IP_EVENT, IP_EVENT_STA_GOT_IP, NULL);
+
+    boot_mark(BOOT_PHASE_RADIO);
+    return ESP_OK;
+}
+
+esp_err_t boot_connect_mqtt(void)
+{
+    mqtt_add_connection_callback(on_mqtt_connection);
+
+    taskENTER_CRITICAL(&s_mux);
+    s_mqtt_ready = true;
+    taskEXIT_CRITICAL(&s_mux);
+    maybe_start_mqtt();
+    return ESP_OK;
+}
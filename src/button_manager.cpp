@@ -3,7 +3,10 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "static_alloc.h"
+#include "trace.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static const char *TAG = "BUTTON";
 
@@ -11,11 +14,12 @@ typedef struct
 {
     uint8_t pin;
     uint32_t tick;
+    int64_t time_us; // esp_timer time of the edge
 } button_event_t;
 
 static QueueHandle_t s_button_queue = NULL;
+STATIC_QUEUE_BUFFERS(s_button_queue, BUTTON_QUEUE_LENGTH, sizeof(button_event_t));
 
-static uint32_t s_debounce_ticks = pdMS_TO_TICKS(200);
 static uint32_t s_last_press_tick_1 = 0;
 static uint32_t s_last_press_tick_2 = 0;
 static uint32_t s_last_press_tick_3 = 0;
@@ -25,7 +29,12 @@ static uint32_t s_last_isr_tick_1 = 0;
 static uint32_t s_last_isr_tick_2 = 0;
 static uint32_t s_last_isr_tick_3 = 0;
 
-static uint8_t s_button_mask = 0xFF;
+// Active mask in the low 8 bits and debounce ticks above, in one word so a
+// press reads both with a single load. Writers come from several tasks.
+#define FILTER_MASK_BITS 8
+#define FILTER_MASK ((1u << FILTER_MASK_BITS) - 1)
+static volatile uint32_t s_filter = (pdMS_TO_TICKS(200) << FILTER_MASK_BITS) | 0xFF;
+static portMUX_TYPE s_filter_mux = portMUX_INITIALIZER_UNLOCKED;
 
 static void IRAM_ATTR button_isr_handler(void *arg)
 {
@@ -55,9 +64,12 @@ static void IRAM_ATTR button_isr_handler(void *arg)
         *last_isr_tick = now;
     }
 
+    TRACE(TRACE_BUTTON_ISR, gpio_num, now);
+
     button_event_t evt;
     evt.pin = (uint8_t)gpio_num;
     evt.tick = now;
+    evt.time_us = esp_timer_get_time();
 
     xQueueSendFromISR(s_button_queue, &evt, NULL);
 }
@@ -77,16 +89,21 @@ static esp_err_t configure_button_gpio(gpio_num_t pin)
     return gpio_isr_handler_add(pin, button_isr_handler, (void *)pin);
 }
 
-esp_err_t button_init(void)
+esp_err_t button_init(QueueSetHandle_t set)
 {
     ESP_LOGI(TAG, "Initializing Buttons...");
 
-    s_button_queue = xQueueCreate(20, sizeof(button_event_t));
+    s_button_queue = STATIC_QUEUE_CREATE(s_button_queue, BUTTON_QUEUE_LENGTH, sizeof(button_event_t));
     if (s_button_queue == NULL)
     {
         ESP_LOGE(TAG, "Failed to create queue");
         return ESP_FAIL;
     }
+    if (set != NULL && xQueueAddToSet(s_button_queue, set) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to add queue to set");
+        return ESP_FAIL;
+    }
 
     esp_err_t err = gpio_install_isr_service(0);
     if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
@@ -104,6 +121,11 @@ esp_err_t button_init(void)
 }
 
 bool button_get_event(uint8_t *button_out, uint32_t wait_ms)
+{
+    return button_get_event_at(button_out, NULL, wait_ms);
+}
+
+bool button_get_event_at(uint8_t *button_out, int64_t *time_us_out, uint32_t wait_ms)
 {
     button_event_t evt;
     TickType_t wait_ticks = (wait_ms == 0) ? 0 : pdMS_TO_TICKS(wait_ms);
@@ -135,35 +157,55 @@ bool button_get_event(uint8_t *button_out, uint32_t wait_ms)
             return false;
         }
 
-        ESP_LOGI(TAG, "RAW Event: ID=%d, Tick=%lu", btn_id, (unsigned long)evt.tick);
+        TRACE(TRACE_BUTTON_EVENT, btn_id, evt.tick);
+
+        uint32_t filter = s_filter;
+        uint8_t mask = (uint8_t)(filter & FILTER_MASK);
+        uint32_t debounce_ticks = filter >> FILTER_MASK_BITS;
 
         // Check Mask
-        if (!((s_button_mask >> (btn_id - 1)) & 0x01))
+        if (!((mask >> (btn_id - 1)) & 0x01))
         {
-            ESP_LOGW(TAG, "Button %d ignored (Mask: 0x%02X)", btn_id, s_button_mask);
+            TRACE(TRACE_BUTTON_MASKED, btn_id, mask);
             return false;
         }
 
         // Debounce Check
-        if ((evt.tick - *last_tick_ptr) > s_debounce_ticks)
+        if ((evt.tick - *last_tick_ptr) > debounce_ticks)
         {
             *last_tick_ptr = evt.tick;
             if (button_out)
                 *button_out = btn_id;
+            if (time_us_out)
+                *time_us_out = evt.time_us;
             return true;
         }
         else
         {
-            ESP_LOGD(TAG, "Button %d debounce bounce (Delta: %lu, Threshold: %lu)",
-                     btn_id, (unsigned long)(evt.tick - *last_tick_ptr), (unsigned long)s_debounce_ticks);
+            TRACE(TRACE_BUTTON_BOUNCE, btn_id, evt.tick - *last_tick_ptr);
             // Bounce detected - ignore this event and retry immediately
-            return button_get_event(button_out, 0);
+            return button_get_event_at(button_out, time_us_out, 0);
         }
     }
 
     return false;
 }
 
+const char *button_player_id(uint8_t btn)
+{
+    switch (btn)
+    {
+    case 1:
+        return "meeple_1";
+    case 2:
+        return "meeple_2";
+    case 3:
+        return "meeple_3";
+    default:
+        return "unknown";
+    }
+}
+
 void button_play_tone(uint8_t btn)
 {
     switch (btn)
@@ -185,16 +227,28 @@ void button_play_tone(uint8_t btn)
 
 void button_set_active_mask(button_active_mask_t mask)
 {
-    s_button_mask = (uint8_t)mask;
-    ESP_LOGI(TAG, "Button mask updated to: 0x%02X", s_button_mask);
+    taskENTER_CRITICAL(&s_filter_mux);
+    s_filter = (s_filter & ~FILTER_MASK) | ((uint32_t)mask & FILTER_MASK);
+    taskEXIT_CRITICAL(&s_filter_mux);
+    ESP_LOGI(TAG, "Button mask updated to: 0x%02X", (uint8_t)mask);
 }
 
 void button_set_debounce_time(uint32_t debounce_ms)
 {
-    s_debounce_ticks = pdMS_TO_TICKS(debounce_ms);
+    taskENTER_CRITICAL(&s_filter_mux);
+    s_filter = ((uint32_t)pdMS_TO_TICKS(debounce_ms) << FILTER_MASK_BITS) | (s_filter & FILTER_MASK);
+    taskEXIT_CRITICAL(&s_filter_mux);
     ESP_LOGI(TAG, "Debounce set to %lu ms", debounce_ms);
 }
 
+void button_set_filter(button_active_mask_t mask, uint32_t debounce_ms)
+{
+    taskENTER_CRITICAL(&s_filter_mux);
+    s_filter = ((uint32_t)pdMS_TO_TICKS(debounce_ms) << FILTER_MASK_BITS) | ((uint32_t)mask & FILTER_MASK);
+    taskEXIT_CRITICAL(&s_filter_mux);
+    ESP_LOGI(TAG, "Button mask 0x%02X, debounce %lu ms", (uint8_t)mask, debounce_ms);
+}
+
 void button_flush_queue(void)
 {
     button_event_t evt;
@@ -205,3 +259,13 @@ void button_flush_queue(void)
     }
     ESP_LOGI(TAG, "Button Queue Flushed");
 }
+
+QueueHandle_t button_get_queue(void)
+{
+    return s_button_queue;
+}
+
+uint32_t button_get_queue_depth(void)
+{
+    return s_button_queue != NULL ? (uint32_t)uxQueueMessagesWaiting(s_button_queue) : 0;
+}
@@ -0,0 +1,523 @@
+#include "button_outbox.h"
+#include "button_manager.h"
+#include "mqtt_manager.h"
+#include "clock_sync.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "static_alloc.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include <stdio.h>
+
+static const char *TAG = "OUTBOX";
+
+// RAM ring, oldest event at s_head. When it fills up, newer events spill to
+// an NVS ring and are pulled back into RAM as the RAM ring drains, so the
+// combined queue always stays in capture order. outbox_push() never touches
+// flash: spilled events wait in s_spill, behind the NVS ring, until the
+// outbox task writes them out.
+// With server acks the first s_inflight events of the ring have been sent and
+// stay queued until a cumulative ack covers them (go-back-N).
+static button_record_t s_ring[OUTBOX_CAPACITY];
+static uint32_t s_head = 0;
+static uint32_t s_count = 0;
+static uint32_t s_inflight = 0;
+static TickType_t s_ack_deadline = 0;
+
+#if OUTBOX_NVS_OVERFLOW
+static nvs_handle_t s_nvs;
+static bool s_nvs_open = false;
+static uint32_t s_nvs_head = 0;
+static uint32_t s_nvs_count = 0;
+static button_record_t s_spill[OUTBOX_SPILL_PENDING];
+static uint32_t s_spill_head = 0;
+static uint32_t s_spill_count = 0;
+#endif
+
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+STATIC_MUTEX_BUFFERS(s_lock);
+STATIC_TASK_BUFFERS(s_task, OUTBOX_TASK_STACK_SIZE);
+static uint32_t s_session = 0;
+static uint32_t s_next_seq = 0;
+static outbox_metrics_t s_metrics = {};
+static uint32_t s_replay_interval_ms = OUTBOX_REPLAY_INTERVAL_MS;
+static bool s_replaying = false;
+static uint32_t s_replay_end = 0; // First seq captured after the backlog
+static TickType_t s_next_send_tick = 0;
+
+#if OUTBOX_NVS_OVERFLOW
+static void nvs_slot_key(uint32_t slot, char *key, size_t len)
+{
+    snprintf(key, len, "r%lu", (unsigned long)slot);
+}
+
+/**
+ * Write a record to an NVS slot (outbox task only, without the lock)
+ */
+static bool nvs_write(uint32_t slot, const button_record_t *rec)
+{
+    if (!s_nvs_open)
+    {
+        if (nvs_open("outbox", NVS_READWRITE, &s_nvs) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to open NVS for overflow");
+            return false;
+        }
+        // Records left by a previous boot carry stale timestamps
+        nvs_erase_all(s_nvs);
+        s_nvs_open = true;
+    }
+
+    char key[12];
+    nvs_slot_key(slot, key, sizeof(key));
+    if (nvs_set_blob(s_nvs, key, rec, sizeof(*rec)) != ESP_OK || nvs_commit(s_nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to spill event %lu to NVS", (unsigned long)rec->seq);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read and erase a record from an NVS slot (outbox task only, without the lock)
+ */
+static bool nvs_take(uint32_t slot, button_record_t *rec)
+{
+    char key[12];
+    nvs_slot_key(slot, key, sizeof(key));
+
+    size_t len = sizeof(*rec);
+    esp_err_t err = nvs_get_blob(s_nvs, key, rec, &len);
+    nvs_erase_key(s_nvs, key);
+    return err == ESP_OK && len == sizeof(*rec);
+}
+#endif
+
+/**
+ * Events behind the RAM ring: in NVS or waiting to be written there
+ */
+static uint32_t nvs_depth(void)
+{
+#if OUTBOX_NVS_OVERFLOW
+    return s_nvs_count + s_spill_count;
+#else
+    return 0;
+#endif
+}
+
+static bool outbox_full(void)
+{
+#if OUTBOX_NVS_OVERFLOW
+    return s_count == OUTBOX_CAPACITY && s_nvs_count >= OUTBOX_NVS_CAPACITY;
+#else
+    return s_count == OUTBOX_CAPACITY;
+#endif
+}
+
+static void ram_append(const button_record_t *rec)
+{
+    s_ring[(s_head + s_count) % OUTBOX_CAPACITY] = *rec;
+    s_count++;
+}
+
+static void ram_drop_head(void)
+{
+    s_head = (s_head + 1) % OUTBOX_CAPACITY;
+    s_count--;
+    if (s_inflight > 0)
+        s_inflight--;
+}
+
+/**
+ * Check whether sequence number a comes at or before b, across wraparound
+ */
+static bool seq_at_or_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) <= 0;
+}
+
+/**
+ * Move spilled events back into the RAM ring while there is room, then write
+ * what is still parked in s_spill to NVS
+ * Outbox task only. Flash is accessed without the lock so presses never wait
+ * on it; only this task moves the NVS ring and the head of s_spill.
+ */
+static void service_spill(void)
+{
+#if OUTBOX_NVS_OVERFLOW
+    while (1)
+    {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool refill = s_count < OUTBOX_CAPACITY && nvs_depth() > 0;
+        bool from_nvs = s_nvs_count > 0;
+        // Pushes may park up to OUTBOX_SPILL_PENDING beyond a full NVS ring;
+        // those wait in RAM until a refill makes room
+        bool flush = !refill && s_spill_count > 0 && s_nvs_count < OUTBOX_NVS_CAPACITY;
+        uint32_t slot = refill ? s_nvs_head : (s_nvs_head + s_nvs_count) % OUTBOX_NVS_CAPACITY;
+        button_record_t rec = s_spill[s_spill_head];
+        xSemaphoreGive(s_lock);
+
+        if (!refill && !flush)
+            return;
+
+        bool ok = true;
+        if (refill && from_nvs)
+            ok = nvs_take(slot, &rec);
+        else if (flush)
+            ok = nvs_write(slot, &rec);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (refill && from_nvs)
+        {
+            s_nvs_head = (s_nvs_head + 1) % OUTBOX_NVS_CAPACITY;
+            s_nvs_count--;
+        }
+        else
+        {
+            // Straight from s_spill into RAM, or written to NVS
+            s_spill_head = (s_spill_head + 1) % OUTBOX_SPILL_PENDING;
+            s_spill_count--;
+            if (flush && ok)
+                s_nvs_count++;
+        }
+        // Presses only append to RAM once nothing is spilled, and everything
+        // else only frees RAM, so the slot checked above is still free
+        if (refill && ok)
+            ram_append(&rec);
+        else if (!ok)
+            s_metrics.dropped++;
+        xSemaphoreGive(s_lock);
+    }
+#endif
+}
+
+/**
+ * Send what can be sent now
+ * @return Ticks to wait before the next attempt
+ */
+static TickType_t drain(void)
+{
+    while (1)
+    {
+        service_spill();
+
+        TickType_t now = xTaskGetTickCount();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_count == 0)
+        {
+            s_replaying = false;
+            xSemaphoreGive(s_lock);
+            return portMAX_DELAY;
+        }
+
+        if (!mqtt_is_connected())
+        {
+            // Unacked events may have died with the connection, send them again
+            s_inflight = 0;
+            s_replaying = true;
+            s_replay_end = s_next_seq;
+            xSemaphoreGive(s_lock);
+            return pdMS_TO_TICKS(OUTBOX_RETRY_MS);
+        }
+
+        // Without acks every send releases the event, so hold the outbox
+        // until the server has said whether it acks on this connection
+        if (mqtt_caps_pending())
+        {
+            xSemaphoreGive(s_lock);
+            return pdMS_TO_TICKS(OUTBOX_CAPS_POLL_MS);
+        }
+
+        bool acks = mqtt_button_acks_enabled();
+        if (!acks)
+        {
+            s_inflight = 0;
+        }
+        else if (s_inflight > 0 && (int32_t)(now - s_ack_deadline) >= 0)
+        {
+            ESP_LOGW(TAG, "No ack for seq %lu, resending %lu events",
+                     (unsigned long)s_ring[s_head].seq, (unsigned long)s_inflight);
+            s_metrics.retransmits += s_inflight;
+            s_inflight = 0;
+        }
+
+        // Window full or everything sent: wait for an ack or the timeout
+        if (s_inflight == s_count || s_inflight >= OUTBOX_WINDOW)
+        {
+            TickType_t wait = s_ack_deadline - now;
+            xSemaphoreGive(s_lock);
+            return wait;
+        }
+
+        // Pace the backlog so a reconnect does not flood the broker, unless a
+        // live press is queued behind it: that one must not wait on pacing
+        bool live_waiting = s_next_seq != s_replay_end;
+        if (s_replaying && !live_waiting && (int32_t)(s_next_send_tick - now) > 0)
+        {
+            xSemaphoreGive(s_lock);
+            return s_next_send_tick - now;
+        }
+
+        button_record_t rec = s_ring[(s_head + s_inflight) % OUTBOX_CAPACITY];
+        xSemaphoreGive(s_lock);
+
+        // Convert at send time so events queued before the first sync still
+        // go out in server time
+        int64_t timestamp_ms = rec.timestamp_ms;
+        int32_t error_ms = -1;
+        int64_t server_us = 0;
+        uint32_t error_us = 0;
+        if (clock_sync_to_server_us(rec.timestamp_ms * 1000, &server_us, &error_us) == ESP_OK)
+        {
+            timestamp_ms = server_us / 1000;
+            error_ms = (int32_t)((error_us + 999) / 1000);
+        }
+
+        if (mqtt_publish_button(button_player_id(rec.button), rec.button, s_session, rec.seq, timestamp_ms, error_ms) != ESP_OK)
+        {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            s_replaying = true;
+            s_replay_end = s_next_seq;
+            xSemaphoreGive(s_lock);
+            return pdMS_TO_TICKS(OUTBOX_RETRY_MS);
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (acks)
+        {
+            // Recount from the head: drops or acks may have moved it meanwhile
+            uint32_t inflight = 0;
+            while (inflight < s_count &&
+                   seq_at_or_before(s_ring[(s_head + inflight) % OUTBOX_CAPACITY].seq, rec.seq))
+            {
+                inflight++;
+            }
+            if (s_inflight == 0 && inflight > 0)
+            {
+                s_ack_deadline = now + pdMS_TO_TICKS(OUTBOX_ACK_TIMEOUT_MS);
+            }
+            s_inflight = inflight;
+        }
+        // The head may have been dropped by OUTBOX_DROP_OLDEST meanwhile
+        else if (s_count > 0 && s_ring[s_head].seq == rec.seq)
+        {
+            ram_drop_head();
+        }
+        s_metrics.sent++;
+        if (s_replaying && seq_at_or_before(rec.seq, s_replay_end - 1))
+        {
+            s_metrics.replayed++;
+            s_next_send_tick = now + pdMS_TO_TICKS(s_replay_interval_ms);
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/**
+ * Release every queued event covered by a cumulative ack
+ */
+static void outbox_ack(uint32_t session, uint32_t seq)
+{
+    if (session != s_session)
+    {
+        ESP_LOGD(TAG, "Ignoring ack for session %08lx", (unsigned long)session);
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t released = 0;
+    while (s_count > 0 && seq_at_or_before(s_ring[s_head].seq, seq))
+    {
+        ram_drop_head();
+        released++;
+    }
+    if (released > 0)
+    {
+        s_metrics.acked += released;
+        s_ack_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(OUTBOX_ACK_TIMEOUT_MS);
+    }
+    xSemaphoreGive(s_lock);
+
+    // The task refills RAM from NVS and sends what the window now allows
+    if (released > 0)
+    {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+/**
+ * Handle a cumulative ack from the server, binary or {"session":..,"seq":..}
+ */
+static void on_button_ack(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx)
+{
+    uint32_t session = 0;
+    uint32_t seq = 0;
+
+    if (wire_is_binary(payload, payload_len))
+    {
+        if (wire_decode_button_ack((const uint8_t *)payload, payload_len, &session, &seq) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Invalid binary button ack");
+            return;
+        }
+    }
+    else
+    {
+        cJSON *root = cJSON_ParseWithLength(payload, payload_len);
+        cJSON *session_item = cJSON_GetObjectItem(root, "session");
+        cJSON *seq_item = cJSON_GetObjectItem(root, "seq");
+        if (!cJSON_IsNumber(session_item) || !cJSON_IsNumber(seq_item))
+        {
+            ESP_LOGW(TAG, "Invalid button ack");
+            cJSON_Delete(root);
+            return;
+        }
+        session = (uint32_t)session_item->valuedouble;
+        seq = (uint32_t)seq_item->valuedouble;
+        cJSON_Delete(root);
+    }
+
+    outbox_ack(session, seq);
+}
+
+static void outbox_task(void *pvParameters)
+{
+    TickType_t wait = portMAX_DELAY;
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, wait);
+        wait = drain();
+    }
+}
+
+esp_err_t outbox_init(void)
+{
+    s_lock = STATIC_MUTEX_CREATE(s_lock);
+    if (s_lock == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return ESP_FAIL;
+    }
+
+    s_metrics.policy = OUTBOX_DROP_OLDEST;
+
+    // A fresh session per boot lets the server tell a reboot from a replay
+    do
+    {
+        s_session = esp_random();
+    } while (s_session == 0);
+    s_metrics.session = s_session;
+
+    s_task = STATIC_TASK_CREATE(s_task, outbox_task, "outbox", OUTBOX_TASK_STACK_SIZE, NULL, OUTBOX_TASK_PRIORITY);
+    if (s_task == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create task");
+        return ESP_FAIL;
+    }
+
+    mqtt_register_handler(MQTT_TOPIC_BUTTON_ACK, 1, on_button_ack, NULL, 10);
+
+    ESP_LOGI(TAG, "Outbox ready (session %08lx, RAM %d, NVS %d)", (unsigned long)s_session,
+             OUTBOX_CAPACITY, OUTBOX_NVS_OVERFLOW ? OUTBOX_NVS_CAPACITY : 0);
+    return ESP_OK;
+}
+
+esp_err_t outbox_push(uint8_t button, int64_t timestamp_ms)
+{
+    if (s_lock == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    // Sequence numbers are only consumed by stored events so the queue has no
+    // gaps a cumulative ack would stall on
+    button_record_t rec = {};
+    rec.seq = s_next_seq;
+    rec.timestamp_ms = timestamp_ms;
+    rec.button = button;
+
+    if (outbox_full())
+    {
+        s_metrics.dropped++;
+        if (s_metrics.policy == OUTBOX_DROP_NEWEST)
+        {
+            ret = ESP_ERR_NO_MEM;
+        }
+        else
+        {
+            ram_drop_head();
+        }
+    }
+
+    if (ret == ESP_OK)
+    {
+        if (nvs_depth() == 0 && s_count < OUTBOX_CAPACITY)
+        {
+            ram_append(&rec);
+        }
+#if OUTBOX_NVS_OVERFLOW
+        else if (s_spill_count == OUTBOX_SPILL_PENDING)
+        {
+            // The outbox task is behind on flash writes
+            s_metrics.dropped++;
+            ret = ESP_ERR_NO_MEM;
+        }
+        else
+        {
+            s_spill[(s_spill_head + s_spill_count) % OUTBOX_SPILL_PENDING] = rec;
+            s_spill_count++;
+        }
+#endif
+
+        uint32_t depth = s_count + nvs_depth();
+        if (depth > s_metrics.high_water)
+            s_metrics.high_water = depth;
+    }
+
+    if (ret == ESP_OK)
+    {
+        s_next_seq++;
+    }
+
+    xSemaphoreGive(s_lock);
+
+    if (ret == ESP_OK)
+    {
+        xTaskNotifyGive(s_task);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Outbox full, dropped event %lu", (unsigned long)rec.seq);
+    }
+    return ret;
+}
+
+void outbox_set_drop_policy(outbox_drop_policy_t policy)
+{
+    s_metrics.policy = policy;
+}
+
+void outbox_set_replay_interval(uint32_t interval_ms)
+{
+    s_replay_interval_ms = interval_ms;
+}
+
+void outbox_get_metrics(outbox_metrics_t *metrics_out)
+{
+    if (metrics_out == NULL || s_lock == NULL)
+        return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *metrics_out = s_metrics;
+    metrics_out->depth = s_count + nvs_depth();
+    metrics_out->inflight = s_inflight;
+    metrics_out->nvs_depth = nvs_depth();
+    xSemaphoreGive(s_lock);
+}
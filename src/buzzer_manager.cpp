@@ -1,4 +1,6 @@
 #include "buzzer_manager.h"
+#include "effect_pool.h"
+#include "trace.h"
 #include "driver/ledc.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
@@ -44,18 +46,23 @@ esp_err_t buzzer_init(void)
 
 void buzzer_tone(uint32_t freq_hz, uint32_t duration_ms)
 {
+    // A cancelled effect skips the rest of its tune
+    if (effect_cancelled())
+        return;
+    TRACE(TRACE_TONE, freq_hz, duration_ms);
+
     if (freq_hz == 0)
     {
         ledc_set_duty(LEDC_MODE, LEDC_CHANNEL, 0);
         ledc_update_duty(LEDC_MODE, LEDC_CHANNEL);
-        vTaskDelay(pdMS_TO_TICKS(duration_ms));
+        effect_sleep_ms(duration_ms);
         return;
     }
 
     ledc_set_freq(LEDC_MODE, LEDC_TIMER, freq_hz);
     ledc_set_duty(LEDC_MODE, LEDC_CHANNEL, LEDC_DUTY);
     ledc_update_duty(LEDC_MODE, LEDC_CHANNEL);
-    vTaskDelay(pdMS_TO_TICKS(duration_ms));
+    effect_sleep_ms(duration_ms);
     ledc_set_duty(LEDC_MODE, LEDC_CHANNEL, 0);
     ledc_update_duty(LEDC_MODE, LEDC_CHANNEL);
 }
@@ -121,7 +128,7 @@ void buzzer_play_dice_roll(void)
     for (int i = 0; i < 15; i++)
     {
         buzzer_tone(200 + (esp_random() % 500), 10);
-        vTaskDelay(pdMS_TO_TICKS(delay));
+        effect_sleep_ms(delay);
         delay += 10;
     }
     // Final "result" ding
@@ -138,13 +145,13 @@ void buzzer_play_damage(void)
 void buzzer_play_countdown(void)
 {
     buzzer_tone(NOTE_C5, 100); // 3
-    vTaskDelay(pdMS_TO_TICKS(900));
+    effect_sleep_ms(900);
 
     buzzer_tone(NOTE_C5, 100); // 2
-    vTaskDelay(pdMS_TO_TICKS(900));
+    effect_sleep_ms(900);
 
     buzzer_tone(NOTE_C5, 100); // 1
-    vTaskDelay(pdMS_TO_TICKS(900));
+    effect_sleep_ms(900);
 
     buzzer_tone(NOTE_C6, 500); // GO!
 }
@@ -192,7 +199,6 @@ void buzzer_play_tone_player_2(void)
 
 void buzzer_play_tone_player_3(void)
 {
-    ESP_LOGI(TAG, "Playing Player 3 Tone");
     // Standardized to C5 160ms
     buzzer_tone(NOTE_C5, 160);
 }
@@ -0,0 +1,342 @@
+#include "clock_sync.h"
+#include "mqtt_manager.h"
+#include "wifi_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "static_alloc.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "CLOCK_SYNC";
+
+// NTP-style exchange: t0 local send, t1 server receive, t2 server send,
+// t3 local receive (taken when esp-mqtt delivered the pong, not when the
+// worker got to it).
+//   offset = ((t1 - t0) + (t2 - t3)) / 2
+//   rtt    = (t3 - t0) - (t2 - t1)
+typedef struct
+{
+    int64_t local_us; // Midpoint of t0 and t3
+    int64_t offset_us;
+    uint32_t rtt_us;
+} clock_sample_t;
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_task = NULL;
+STATIC_TASK_BUFFERS(s_task, CLOCK_SYNC_TASK_STACK_SIZE);
+
+// Outstanding ping and its answer, shared with the MQTT worker
+static int64_t s_ping_t0 = 0;
+static bool s_pong_valid = false;
+static clock_sample_t s_pong;
+
+// Best sample of each recent round, oldest first
+static clock_sample_t s_history[CLOCK_SYNC_HISTORY];
+static int s_history_count = 0;
+
+static clock_sync_status_t s_status = {};
+static bool s_drift_known = false;
+
+/**
+ * Handle a pong from the server
+ */
+static void on_pong_message(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx)
+{
+    int64_t t3 = mqtt_message_rx_time_us();
+
+    cJSON *root = cJSON_ParseWithLength(payload, payload_len);
+    cJSON *t0_item = cJSON_GetObjectItem(root, "t0");
+    cJSON *t1_item = cJSON_GetObjectItem(root, "t1");
+    cJSON *t2_item = cJSON_GetObjectItem(root, "t2");
+    if (!cJSON_IsNumber(t0_item) || !cJSON_IsNumber(t1_item) || !cJSON_IsNumber(t2_item))
+    {
+        ESP_LOGW(TAG, "Invalid pong");
+        cJSON_Delete(root);
+        return;
+    }
+    int64_t t0 = (int64_t)t0_item->valuedouble;
+    int64_t t1 = (int64_t)t1_item->valuedouble;
+    int64_t t2 = (int64_t)t2_item->valuedouble;
+    cJSON_Delete(root);
+
+    int64_t rtt = (t3 - t0) - (t2 - t1);
+    if (rtt < 0)
+    {
+        ESP_LOGW(TAG, "Discarding pong with negative RTT");
+        return;
+    }
+
+    bool matched = false;
+    taskENTER_CRITICAL(&s_mux);
+    // Late answers to an earlier ping are ignored
+    if (t0 == s_ping_t0 && !s_pong_valid)
+    {
+        s_pong.local_us = t0 + (t3 - t0) / 2;
+        s_pong.offset_us = ((t1 - t0) + (t2 - t3)) / 2;
+        s_pong.rtt_us = (uint32_t)rtt;
+        s_pong_valid = true;
+        matched = true;
+    }
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (matched)
+    {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+/**
+ * Ping once and wait for the answer
+ * @return true if sample_out was filled
+ */
+static bool ping_once(clock_sample_t *sample_out)
+{
+    int64_t t0 = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_mux);
+    s_ping_t0 = t0;
+    s_pong_valid = false;
+    taskEXIT_CRITICAL(&s_mux);
+
+    ulTaskNotifyTake(pdTRUE, 0);
+    if (mqtt_publish_time_ping(t0) != ESP_OK)
+        return false;
+
+    bool got = false;
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CLOCK_SYNC_TIMEOUT_MS);
+    while (!got)
+    {
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(deadline - now) <= 0)
+            break;
+        ulTaskNotifyTake(pdTRUE, deadline - now);
+
+        taskENTER_CRITICAL(&s_mux);
+        got = s_pong_valid;
+        if (got)
+            *sample_out = s_pong;
+        taskEXIT_CRITICAL(&s_mux);
+    }
+
+    if (!got)
+    {
+        taskENTER_CRITICAL(&s_mux);
+        s_status.timeouts++;
+        taskEXIT_CRITICAL(&s_mux);
+    }
+    return got;
+}
+
+/**
+ * Fit offset and drift to the history and publish the new estimate
+ */
+static void update_estimate(void)
+{
+    uint32_t best_rtt = UINT32_MAX;
+    int best = 0;
+    for (int i = 0; i < s_history_count; i++)
+    {
+        if (s_history[i].rtt_us < best_rtt)
+        {
+            best_rtt = s_history[i].rtt_us;
+            best = i;
+        }
+    }
+
+    // Least-squares line through the samples whose RTT is close to the best
+    const clock_sample_t *newest = &s_history[s_history_count - 1];
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int n = 0;
+    int64_t oldest_local = newest->local_us;
+    for (int i = 0; i < s_history_count; i++)
+    {
+        if (s_history[i].rtt_us > best_rtt * CLOCK_SYNC_RTT_FILTER)
+            continue;
+        double x = (double)(s_history[i].local_us - newest->local_us);
+        double y = (double)(s_history[i].offset_us - s_history[best].offset_us);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        n++;
+        if (s_history[i].local_us < oldest_local)
+            oldest_local = s_history[i].local_us;
+    }
+
+    int64_t ref_us = s_history[best].local_us;
+    int64_t offset_us = s_history[best].offset_us;
+    double drift = 0;
+    bool drift_known = false;
+    double denom = n * sxx - sx * sx;
+    if (n >= 2 && newest->local_us - oldest_local >= (int64_t)CLOCK_SYNC_MIN_DRIFT_SPAN_MS * 1000 && denom > 0)
+    {
+        drift = (n * sxy - sx * sy) / denom;
+        double max_drift = CLOCK_SYNC_MAX_DRIFT_PPM / 1e6;
+        if (drift > max_drift)
+            drift = max_drift;
+        if (drift < -max_drift)
+            drift = -max_drift;
+        ref_us = newest->local_us;
+        offset_us = s_history[best].offset_us + (int64_t)((sy - drift * sx) / n);
+        drift_known = true;
+    }
+
+    // Error bound: half the best RTT plus how far the filtered samples stray from the line
+    double max_residual = 0;
+    for (int i = 0; i < s_history_count; i++)
+    {
+        if (s_history[i].rtt_us > best_rtt * CLOCK_SYNC_RTT_FILTER)
+            continue;
+        double predicted = offset_us + drift * (double)(s_history[i].local_us - ref_us);
+        double residual = fabs((double)s_history[i].offset_us - predicted);
+        if (residual > max_residual)
+            max_residual = residual;
+    }
+
+    taskENTER_CRITICAL(&s_mux);
+    s_status.synced = true;
+    s_status.offset_us = offset_us;
+    s_status.ref_local_us = ref_us;
+    s_status.drift_ppm = (float)(drift * 1e6);
+    s_status.rtt_us = best_rtt;
+    s_status.error_us = best_rtt / 2 + (uint32_t)max_residual;
+    s_status.rounds++;
+    s_drift_known = drift_known;
+    taskEXIT_CRITICAL(&s_mux);
+
+    // Fixed point: newlib's float formatting mallocs on first use
+    long drift_cppm = (long)(drift * 1e8);
+    ESP_LOGI(TAG, "Offset %lld us, drift %s%ld.%02ld ppm, rtt %lu us, error %lu us",
+             offset_us, drift_cppm < 0 ? "-" : "", labs(drift_cppm) / 100, labs(drift_cppm) % 100,
+             (unsigned long)best_rtt, (unsigned long)s_status.error_us);
+}
+
+/**
+ * Run one burst and fold its best sample into the history
+ * @return true if the round produced a sample
+ */
+static bool sync_round(void)
+{
+    clock_sample_t best = {};
+    bool have = false;
+
+    for (int i = 0; i < CLOCK_SYNC_BURST; i++)
+    {
+        clock_sample_t sample;
+        if (ping_once(&sample))
+        {
+            // Every ping doubles as a latency probe for the radio profile
+            wifi_record_rtt(sample.rtt_us);
+            taskENTER_CRITICAL(&s_mux);
+            s_status.samples++;
+            taskEXIT_CRITICAL(&s_mux);
+            if (!have || sample.rtt_us < best.rtt_us)
+            {
+                best = sample;
+                have = true;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(CLOCK_SYNC_BURST_GAP_MS));
+    }
+
+    if (!have)
+        return false;
+
+    if (s_history_count == CLOCK_SYNC_HISTORY)
+    {
+        memmove(&s_history[0], &s_history[1], sizeof(s_history[0]) * (CLOCK_SYNC_HISTORY - 1));
+        s_history_count--;
+    }
+    s_history[s_history_count++] = best;
+    update_estimate();
+    return true;
+}
+
+static void clock_sync_task(void *pvParameters)
+{
+    uint32_t rounds = 0;
+    while (1)
+    {
+        if (mqtt_is_connected() && sync_round())
+        {
+            rounds++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(rounds < CLOCK_SYNC_FAST_ROUNDS ? CLOCK_SYNC_FAST_INTERVAL_MS : CLOCK_SYNC_INTERVAL_MS));
+    }
+}
+
+esp_err_t clock_sync_init(void)
+{
+    s_task = STATIC_TASK_CREATE(s_task, clock_sync_task, "clock_sync", CLOCK_SYNC_TASK_STACK_SIZE, NULL, CLOCK_SYNC_TASK_PRIORITY);
+    if (s_task == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create task");
+        return ESP_FAIL;
+    }
+
+    mqtt_register_handler(MQTT_TOPIC_TIME_PONG, 0, on_pong_message, NULL, 10);
+    ESP_LOGI(TAG, "Clock sync started");
+    return ESP_OK;
+}
+
+bool clock_sync_is_synced(void)
+{
+    return s_status.synced;
+}
+
+esp_err_t clock_sync_to_server_us(int64_t local_us, int64_t *server_us_out, uint32_t *error_us_out)
+{
+    if (server_us_out == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    taskENTER_CRITICAL(&s_mux);
+    clock_sync_status_t status = s_status;
+    bool drift_known = s_drift_known;
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (!status.synced)
+        return ESP_ERR_INVALID_STATE;
+
+    int64_t age_us = local_us - status.ref_local_us;
+    *server_us_out = local_us + status.offset_us + (int64_t)(status.drift_ppm * age_us / 1e6);
+
+    if (error_us_out != NULL)
+    {
+        // Extrapolation adds uncertainty; more of it while the drift is unknown
+        uint32_t margin_ppm = drift_known ? CLOCK_SYNC_DRIFT_MARGIN_PPM : CLOCK_SYNC_MAX_DRIFT_PPM;
+        *error_us_out = status.error_us + (uint32_t)(llabs(age_us) * margin_ppm / 1000000);
+    }
+    return ESP_OK;
+}
+
+esp_err_t clock_sync_to_local_us(int64_t server_us, int64_t *local_us_out)
+{
+    if (local_us_out == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    taskENTER_CRITICAL(&s_mux);
+    clock_sync_status_t status = s_status;
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (!status.synced)
+        return ESP_ERR_INVALID_STATE;
+
+    // Drift is tiny, so one correction step is enough
+    int64_t local_us = server_us - status.offset_us;
+    local_us -= (int64_t)(status.drift_ppm * (local_us - status.ref_local_us) / 1e6);
+    *local_us_out = local_us;
+    return ESP_OK;
+}
+
+void clock_sync_get_status(clock_sync_status_t *status_out)
+{
+    if (status_out == NULL)
+        return;
+
+    taskENTER_CRITICAL(&s_mux);
+    *status_out = s_status;
+    taskEXIT_CRITICAL(&s_mux);
+}
@@ -0,0 +1,299 @@
+#include "cue_scheduler.h"
+#include "clock_sync.h"
+#include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "static_alloc.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "CUE";
+
+typedef struct
+{
+    bool armed;
+    uint32_t id;
+    char cue[CUE_NAME_MAX];
+    size_t cue_len;
+    int64_t server_us; // Requested time, 0 for "play now"
+    int64_t local_us;  // Same time on our clock
+    esp_timer_handle_t timer;
+} cue_slot_t;
+
+static cue_slot_t s_slots[CUE_MAX_PENDING];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t s_due_queue = NULL;
+STATIC_QUEUE_BUFFERS(s_due_queue, CUE_MAX_PENDING, sizeof(int));
+STATIC_TASK_BUFFERS(s_task, CUE_TASK_STACK_SIZE);
+static cue_fire_t s_fire = NULL;
+
+static const char *result_name(cue_result_t result)
+{
+    switch (result)
+    {
+    case CUE_FIRED:
+        return "fired";
+    case CUE_LATE:
+        return "late";
+    case CUE_UNSYNCED:
+        return "unsynced";
+    case CUE_UNKNOWN:
+        return "unknown";
+    default:
+        return "rejected";
+    }
+}
+
+/**
+ * Tell the server what happened to a cue
+ * @param fired_local_us Local time the cue started, 0 if it did not play
+ */
+static void report(uint32_t id, const char *cue, size_t cue_len, cue_result_t result,
+                   int64_t server_us, int64_t fired_local_us)
+{
+    char payload[192];
+    int len = snprintf(payload, sizeof(payload), "{\"id\":%lu,\"cue\":\"%.*s\",\"result\":\"%s\",\"at\":%lld",
+                       (unsigned long)id, (int)cue_len, cue, result_name(result), server_us);
+
+    int64_t fired_server_us = 0;
+    uint32_t error_us = 0;
+    if (fired_local_us != 0 && clock_sync_to_server_us(fired_local_us, &fired_server_us, &error_us) == ESP_OK)
+    {
+        len += snprintf(payload + len, sizeof(payload) - len, ",\"fired\":%lld,\"skew_us\":%lld,\"err_us\":%lu",
+                        fired_server_us, server_us != 0 ? fired_server_us - server_us : 0LL, (unsigned long)error_us);
+    }
+    len += snprintf(payload + len, sizeof(payload) - len, "}");
+
+    mqtt_publish_cue_report(payload, len);
+}
+
+/**
+ * esp_timer callback: hand the slot to the cue task
+ */
+static void on_cue_timer(void *arg)
+{
+    int slot = (int)(intptr_t)arg;
+    xQueueSend(s_due_queue, &slot, 0);
+}
+
+static void cue_task(void *pvParameters)
+{
+    while (1)
+    {
+        int index = 0;
+        if (xQueueReceive(s_due_queue, &index, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        taskENTER_CRITICAL(&s_mux);
+        cue_slot_t slot = s_slots[index];
+        taskEXIT_CRITICAL(&s_mux);
+        if (!slot.armed)
+            continue; // Cancelled
+
+        // Spin out the last stretch; the timer woke us early on purpose
+        if (slot.server_us != 0)
+        {
+            while (esp_timer_get_time() < slot.local_us)
+            {
+            }
+        }
+
+        // Report when the effect started, not when it was handed off
+        int64_t fired_local_us = 0;
+        esp_err_t err = s_fire(slot.cue, slot.cue_len, &fired_local_us);
+
+        taskENTER_CRITICAL(&s_mux);
+        s_slots[index].armed = false;
+        taskEXIT_CRITICAL(&s_mux);
+
+        cue_result_t result = slot.server_us == 0 ? CUE_UNSYNCED : CUE_FIRED;
+        if (err == ESP_ERR_NOT_FOUND)
+        {
+            result = CUE_UNKNOWN;
+            ESP_LOGW(TAG, "Unknown cue: %.*s", (int)slot.cue_len, slot.cue);
+        }
+        else if (err == ESP_ERR_TIMEOUT)
+        {
+            fired_local_us = 0;
+            ESP_LOGW(TAG, "Cue %lu (%.*s) did not start within %d ms", (unsigned long)slot.id,
+                     (int)slot.cue_len, slot.cue, CUE_START_TIMEOUT_MS);
+        }
+        else if (err != ESP_OK)
+        {
+            result = CUE_REJECTED;
+            fired_local_us = 0;
+            ESP_LOGW(TAG, "Cue %lu (%.*s) refused: %s", (unsigned long)slot.id, (int)slot.cue_len, slot.cue,
+                     esp_err_to_name(err));
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Cue %lu (%.*s) started %lld us after its local time", (unsigned long)slot.id,
+                     (int)slot.cue_len, slot.cue, fired_local_us - slot.local_us);
+        }
+        report(slot.id, slot.cue, slot.cue_len, result, slot.server_us, fired_local_us);
+    }
+}
+
+/**
+ * Handle {"id":<n>,"cue":"<name>","at":<server us>}
+ */
+static void on_cue_message(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx)
+{
+    cJSON *root = cJSON_ParseWithLength(payload, payload_len);
+    cJSON *id_item = cJSON_GetObjectItem(root, "id");
+    const char *cue = cJSON_GetStringValue(cJSON_GetObjectItem(root, "cue"));
+    cJSON *at_item = cJSON_GetObjectItem(root, "at");
+    if (cue == NULL || !cJSON_IsNumber(at_item))
+    {
+        ESP_LOGW(TAG, "Invalid cue message");
+        cJSON_Delete(root);
+        return;
+    }
+
+    uint32_t id = cJSON_IsNumber(id_item) ? (uint32_t)id_item->valuedouble : 0;
+    esp_err_t err = cue_schedule(id, cue, strlen(cue), (int64_t)at_item->valuedouble);
+    if (err != ESP_OK && err != ESP_ERR_TIMEOUT)
+    {
+        report(id, cue, strlen(cue), CUE_REJECTED, (int64_t)at_item->valuedouble, 0);
+    }
+    cJSON_Delete(root);
+}
+
+/**
+ * A cue armed before a disconnect belongs to a game state the server may
+ * have moved on from, and its report could not be sent anyway
+ */
+static void on_mqtt_connection(bool connected)
+{
+    if (!connected)
+    {
+        cue_cancel_all();
+    }
+}
+
+esp_err_t cue_scheduler_init(cue_fire_t fire)
+{
+    if (fire == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_fire = fire;
+
+    s_due_queue = STATIC_QUEUE_CREATE(s_due_queue, CUE_MAX_PENDING, sizeof(int));
+    if (s_due_queue == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create queue");
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < CUE_MAX_PENDING; i++)
+    {
+        esp_timer_create_args_t args = {};
+        args.callback = on_cue_timer;
+        args.arg = (void *)(intptr_t)i;
+        args.name = "cue";
+        if (esp_timer_create(&args, &s_slots[i].timer) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to create timer");
+            return ESP_FAIL;
+        }
+    }
+
+    if (STATIC_TASK_CREATE(s_task, cue_task, "cue", CUE_TASK_STACK_SIZE, NULL, CUE_TASK_PRIORITY) == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create task");
+        return ESP_FAIL;
+    }
+
+    mqtt_register_handler(MQTT_TOPIC_CUE, 1, on_cue_message, NULL, 20);
+    mqtt_add_connection_callback(on_mqtt_connection);
+    return ESP_OK;
+}
+
+esp_err_t cue_schedule(uint32_t id, const char *cue, size_t len, int64_t server_us)
+{
+    if (cue == NULL || len >= CUE_NAME_MAX || s_due_queue == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t local_us = 0;
+    bool synced = clock_sync_to_local_us(server_us, &local_us) == ESP_OK;
+
+    if (synced && local_us - now > (int64_t)CUE_MAX_LEAD_MS * 1000)
+    {
+        ESP_LOGW(TAG, "Cue %lu is too far ahead", (unsigned long)id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (synced && now - local_us > (int64_t)CUE_LATE_TOLERANCE_MS * 1000)
+    {
+        ESP_LOGW(TAG, "Cue %lu arrived %lld ms late", (unsigned long)id, (now - local_us) / 1000);
+        report(id, cue, len, CUE_LATE, server_us, 0);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    int index = -1;
+    taskENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < CUE_MAX_PENDING; i++)
+    {
+        if (!s_slots[i].armed)
+        {
+            index = i;
+            cue_slot_t *slot = &s_slots[i];
+            slot->armed = true;
+            slot->id = id;
+            memcpy(slot->cue, cue, len);
+            slot->cue[len] = '\0';
+            slot->cue_len = len;
+            // Without a clock estimate all we can do is play it now
+            slot->server_us = synced ? server_us : 0;
+            slot->local_us = synced ? local_us : now;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (index < 0)
+    {
+        ESP_LOGW(TAG, "No free cue slot for %lu", (unsigned long)id);
+        return ESP_ERR_NO_MEM;
+    }
+
+    int64_t delay_us = local_us - CUE_WAKE_EARLY_US - now;
+    if (!synced || delay_us <= 0)
+    {
+        xQueueSend(s_due_queue, &index, 0);
+    }
+    else
+    {
+        esp_timer_start_once(s_slots[index].timer, delay_us);
+    }
+
+    ESP_LOGI(TAG, "Cue %lu (%.*s) armed %lld us ahead", (unsigned long)id, (int)len, cue, synced ? local_us - now : 0LL);
+    return ESP_OK;
+}
+
+void cue_cancel_all(void)
+{
+    int cancelled = 0;
+    for (int i = 0; i < CUE_MAX_PENDING; i++)
+    {
+        if (s_slots[i].timer != NULL)
+            esp_timer_stop(s_slots[i].timer);
+        // A slot already handed to the cue task is skipped once disarmed
+        taskENTER_CRITICAL(&s_mux);
+        if (s_slots[i].armed)
+            cancelled++;
+        s_slots[i].armed = false;
+        taskEXIT_CRITICAL(&s_mux);
+    }
+    if (cancelled > 0)
+    {
+        ESP_LOGW(TAG, "Cancelled %d armed cues", cancelled);
+    }
+}
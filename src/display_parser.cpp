@@ -0,0 +1,459 @@
+#include "display_parser.h"
+#include <ctype.h>
+#include <string.h>
+
+// Single-pass JSON scanner specialised for the display schema.
+// Nothing is allocated: strings are decoded directly into caller buffers and
+// nesting is bounded by DISPLAY_PARSER_MAX_DEPTH. Results follow what the old
+// cJSON code saw (case-insensitive keys, valueint truncation); the remaining
+// differences are listed in the README and checked by tools/display_parser_bench.cpp.
+
+typedef struct
+{
+    const char *pos;
+    const char *end;
+    int depth;
+} parser_t;
+
+typedef struct
+{
+    bool seen;
+    bool is_string;
+} field_t;
+
+static void skip_ws(parser_t *p)
+{
+    while (p->pos < p->end && (*p->pos == ' ' || *p->pos == '\t' || *p->pos == '\n' || *p->pos == '\r'))
+        p->pos++;
+}
+
+static bool consume(parser_t *p, char c)
+{
+    skip_ws(p);
+    if (p->pos < p->end && *p->pos == c)
+    {
+        p->pos++;
+        return true;
+    }
+    return false;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex4(parser_t *p, int *code)
+{
+    if (p->end - p->pos < 4)
+        return false;
+    *code = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int v = hex_value(p->pos[i]);
+        if (v < 0)
+            return false;
+        *code = (*code << 4) | v;
+    }
+    p->pos += 4;
+    return true;
+}
+
+/**
+ * Parse a string token, decoding at most cap - 1 characters into dst.
+ * dst may be NULL to skip. *decoded_len receives the full decoded length.
+ * Like a C string, everything after an escaped NUL is dropped.
+ */
+static bool parse_string(parser_t *p, char *dst, size_t cap, size_t *decoded_len)
+{
+    if (p->pos >= p->end || *p->pos != '"')
+        return false;
+    p->pos++;
+
+    size_t n = 0;
+    bool terminated = false;
+    while (p->pos < p->end)
+    {
+        char c = *p->pos++;
+        if (c == '"')
+        {
+            if (dst != NULL)
+                dst[n < cap ? n : cap - 1] = '\0';
+            if (decoded_len != NULL)
+                *decoded_len = n;
+            return true;
+        }
+
+        if ((uint8_t)c < 0x20)
+            return false;
+
+        if (c == '\\')
+        {
+            if (p->pos >= p->end)
+                return false;
+
+            char esc = *p->pos++;
+            switch (esc)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                c = esc;
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+            {
+                int code;
+                if (!parse_hex4(p, &code) || (code >= 0xDC00 && code <= 0xDFFF))
+                    return false;
+                // A high surrogate must be followed by its low half
+                if (code >= 0xD800 && code <= 0xDBFF)
+                {
+                    int low;
+                    if (p->end - p->pos < 2 || p->pos[0] != '\\' || p->pos[1] != 'u')
+                        return false;
+                    p->pos += 2;
+                    if (!parse_hex4(p, &low) || low < 0xDC00 || low > 0xDFFF)
+                        return false;
+                }
+                // The HD44780 character ROM is ASCII only
+                c = code < 0x80 ? (char)code : '?';
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+
+        if (c == '\0')
+            terminated = true;
+        if (terminated)
+            continue;
+        if (dst != NULL && n + 1 < cap)
+            dst[n] = c;
+        n++;
+    }
+    return false;
+}
+
+static bool is_digit(const parser_t *p)
+{
+    return p->pos < p->end && *p->pos >= '0' && *p->pos <= '9';
+}
+
+static const char *skip_digits(parser_t *p)
+{
+    while (is_digit(p))
+        p->pos++;
+    return p->pos;
+}
+
+/**
+ * Parse a number token. *int_out receives the value truncated toward zero and
+ * saturated to int32, which is what cJSON's valueint holds. The digits are
+ * shifted by the exponent in decimal so no strtod (and no allocation) is needed.
+ */
+static bool parse_number(parser_t *p, int32_t *int_out)
+{
+    bool negative = false;
+    if (p->pos < p->end && *p->pos == '-')
+    {
+        negative = true;
+        p->pos++;
+    }
+
+    if (!is_digit(p))
+        return false;
+    if (*p->pos == '0' && p->pos + 1 < p->end && p->pos[1] >= '0' && p->pos[1] <= '9')
+        return false;
+
+    const char *int_digits = p->pos;
+    const char *int_end = skip_digits(p);
+    const char *frac_digits = int_end;
+    const char *frac_end = int_end;
+
+    if (p->pos < p->end && *p->pos == '.')
+    {
+        p->pos++;
+        if (!is_digit(p))
+            return false;
+        frac_digits = p->pos;
+        frac_end = skip_digits(p);
+    }
+
+    int32_t exponent = 0;
+    if (p->pos < p->end && (*p->pos == 'e' || *p->pos == 'E'))
+    {
+        p->pos++;
+        bool exp_negative = false;
+        if (p->pos < p->end && (*p->pos == '+' || *p->pos == '-'))
+            exp_negative = *p->pos++ == '-';
+        if (!is_digit(p))
+            return false;
+        while (is_digit(p))
+        {
+            if (exponent < 1000000)
+                exponent = exponent * 10 + (*p->pos - '0');
+            p->pos++;
+        }
+        if (exp_negative)
+            exponent = -exponent;
+    }
+
+    if (int_out == NULL)
+        return true;
+
+    // Digits left of the decimal point once the exponent is applied
+    int64_t keep = (int64_t)(int_end - int_digits) + exponent;
+    int64_t limit = negative ? (int64_t)INT32_MAX + 1 : INT32_MAX;
+    int64_t value = 0;
+    const char *d = int_digits;
+    for (int64_t i = 0; i < keep && value <= limit; i++)
+    {
+        if (d == int_end)
+            d = frac_digits;
+        if (d == frac_end && value == 0)
+            break;
+        value = value * 10 + (d < frac_end ? *d++ - '0' : 0);
+    }
+
+    if (value > limit)
+        value = limit;
+    *int_out = (int32_t)(negative ? -value : value);
+    return true;
+}
+
+static bool parse_literal(parser_t *p, const char *word, size_t len)
+{
+    if ((size_t)(p->end - p->pos) < len || memcmp(p->pos, word, len) != 0)
+        return false;
+    p->pos += len;
+    return true;
+}
+
+static bool skip_value(parser_t *p);
+
+/**
+ * Parse the members of an object or elements of an array, skipping values
+ */
+static bool skip_container(parser_t *p, char close, bool is_object)
+{
+    if (++p->depth > DISPLAY_PARSER_MAX_DEPTH)
+        return false;
+
+    if (consume(p, close))
+    {
+        p->depth--;
+        return true;
+    }
+
+    do
+    {
+        if (is_object)
+        {
+            skip_ws(p);
+            if (!parse_string(p, NULL, 0, NULL) || !consume(p, ':'))
+                return false;
+        }
+        if (!skip_value(p))
+            return false;
+    } while (consume(p, ','));
+
+    p->depth--;
+    return consume(p, close);
+}
+
+static bool skip_value(parser_t *p)
+{
+    skip_ws(p);
+    if (p->pos >= p->end)
+        return false;
+
+    switch (*p->pos)
+    {
+    case '{':
+        p->pos++;
+        return skip_container(p, '}', true);
+    case '[':
+        p->pos++;
+        return skip_container(p, ']', false);
+    case '"':
+        return parse_string(p, NULL, 0, NULL);
+    case 't':
+        return parse_literal(p, "true", 4);
+    case 'f':
+        return parse_literal(p, "false", 5);
+    case 'n':
+        return parse_literal(p, "null", 4);
+    default:
+        return parse_number(p, NULL);
+    }
+}
+
+/**
+ * Compare a decoded key with a field name ignoring case, as cJSON_GetObjectItem does
+ */
+static bool key_is(const char *key, size_t key_len, const char *name)
+{
+    if (key_len != strlen(name))
+        return false;
+    for (size_t i = 0; i < key_len; i++)
+    {
+        if (tolower((unsigned char)key[i]) != name[i])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Parse a value that should be a string into dst if it is one
+ */
+static bool parse_text_field(parser_t *p, field_t *field, char *dst, size_t cap)
+{
+    skip_ws(p);
+    bool first = !field->seen;
+    field->seen = true;
+
+    // First occurrence wins, like a key lookup would
+    if (first && p->pos < p->end && *p->pos == '"')
+    {
+        field->is_string = true;
+        return parse_string(p, dst, cap, NULL);
+    }
+    return skip_value(p);
+}
+
+/**
+ * Parse the buttons array into a mask
+ */
+static bool parse_buttons(parser_t *p, field_t *field, display_update_t *out)
+{
+    skip_ws(p);
+    bool first = !field->seen;
+    field->seen = true;
+    if (!first || p->pos >= p->end || *p->pos != '[')
+        return skip_value(p);
+
+    p->pos++;
+    out->has_buttons = true;
+    out->button_mask = 0;
+
+    if (consume(p, ']'))
+        return true;
+
+    do
+    {
+        skip_ws(p);
+        if (p->pos < p->end && (*p->pos == '-' || (*p->pos >= '0' && *p->pos <= '9')))
+        {
+            int32_t id = 0;
+            if (!parse_number(p, &id))
+                return false;
+            // Button n is bit n - 1 of button_active_mask_t
+            if (id >= 1 && id <= 3)
+                out->button_mask |= (uint8_t)(1 << (id - 1));
+        }
+        else if (!skip_value(p))
+        {
+            return false;
+        }
+    } while (consume(p, ','));
+
+    return consume(p, ']');
+}
+
+esp_err_t display_parse(const char *json, size_t len, display_update_t *out)
+{
+    if (json == NULL || out == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(out, 0, sizeof(*out));
+    parser_t p = {json, json + len, 0};
+
+    field_t line1 = {};
+    field_t line2 = {};
+    field_t message = {};
+    field_t msg = {};
+    field_t buttons = {};
+    char message_text[LCD_COLS + 1] = "";
+    char msg_text[LCD_COLS + 1] = "";
+
+    skip_ws(&p);
+    if (p.pos >= p.end)
+        return ESP_ERR_INVALID_ARG;
+
+    // Any other root value is valid JSON that simply carries no display fields
+    if (*p.pos != '{')
+        return skip_value(&p) ? ESP_OK : ESP_ERR_INVALID_ARG;
+
+    p.pos++;
+    p.depth = 1;
+
+    if (!consume(&p, '}'))
+    {
+        do
+        {
+            char key[8];
+            size_t key_len = 0;
+            skip_ws(&p);
+            if (!parse_string(&p, key, sizeof(key), &key_len) || !consume(&p, ':'))
+                return ESP_ERR_INVALID_ARG;
+
+            bool ok;
+            if (key_is(key, key_len, "line1"))
+                ok = parse_text_field(&p, &line1, out->frame.lines[0], sizeof(out->frame.lines[0]));
+            else if (key_is(key, key_len, "line2"))
+                ok = parse_text_field(&p, &line2, out->frame.lines[1], sizeof(out->frame.lines[1]));
+            else if (key_is(key, key_len, "message"))
+                ok = parse_text_field(&p, &message, message_text, sizeof(message_text));
+            else if (key_is(key, key_len, "msg"))
+                ok = parse_text_field(&p, &msg, msg_text, sizeof(msg_text));
+            else if (key_is(key, key_len, "buttons"))
+                ok = parse_buttons(&p, &buttons, out);
+            else
+                ok = skip_value(&p);
+
+            if (!ok)
+                return ESP_ERR_INVALID_ARG;
+        } while (consume(&p, ','));
+
+        if (!consume(&p, '}'))
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    // line1/line2 take priority; absent or non-string rows stay empty
+    if (line1.seen || line2.seen)
+    {
+        out->has_text = true;
+    }
+    else if (message.is_string || msg.is_string)
+    {
+        out->has_text = true;
+        memcpy(out->frame.lines[0], message.is_string ? message_text : msg_text, sizeof(out->frame.lines[0]));
+        out->frame.lines[1][0] = '\0';
+    }
+
+    return ESP_OK;
+}
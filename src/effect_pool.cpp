@@ -0,0 +1,237 @@
+#include "effect_pool.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "trace.h"
+
+static const char *TAG = "EFFECT";
+
+typedef struct
+{
+    effect_fn_t fn;
+    uint32_t generation; // Channel generation when posted
+    TaskHandle_t waiter; // Notified with the start time, or NULL
+} effect_job_t;
+
+typedef struct
+{
+    const char *name;
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    uint32_t generation; // Bumped by every cancel; older jobs are stale
+    uint32_t running;    // Generation of the job being run
+    uint32_t pending;    // Queued plus running
+    effect_stats_t stats;
+
+    StaticQueue_t queue_buf;
+    uint8_t queue_storage[EFFECT_QUEUE_LENGTH * sizeof(effect_job_t)];
+    StaticTask_t task_buf;
+    StackType_t stack[EFFECT_TASK_STACK_SIZE]; // Bytes on ESP-IDF
+} effect_worker_t;
+
+static const char *const WORKER_NAMES[EFFECT_CHANNEL_COUNT] = {"fx_sound", "fx_sequence"};
+
+// Posts come from the MQTT worker, the main task and the cue task
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static effect_worker_t s_workers[EFFECT_CHANNEL_COUNT];
+
+static effect_worker_t *current_worker(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < EFFECT_CHANNEL_COUNT; i++)
+    {
+        if (s_workers[i].task == self)
+            return &s_workers[i];
+    }
+    return NULL;
+}
+
+static void effect_task(void *arg)
+{
+    effect_worker_t *w = (effect_worker_t *)arg;
+    effect_job_t job;
+
+    while (1)
+    {
+        if (xQueueReceive(w->queue, &job, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        taskENTER_CRITICAL(&s_mux);
+        bool stale = job.generation != w->generation;
+        w->running = job.generation;
+        taskEXIT_CRITICAL(&s_mux);
+
+        if (!stale)
+        {
+            // Drop a wake-up left over from a cancel that hit nothing
+            ulTaskNotifyTake(pdTRUE, 0);
+            if (job.waiter != NULL)
+                xTaskNotify(job.waiter, (uint32_t)esp_timer_get_time(), eSetValueWithOverwrite);
+            TRACE(TRACE_EFFECT_BEGIN, w - s_workers, (uintptr_t)job.fn);
+            job.fn();
+        }
+
+        taskENTER_CRITICAL(&s_mux);
+        bool cancelled = stale || w->running != w->generation;
+        if (cancelled)
+            w->stats.cancelled++;
+        else
+            w->stats.completed++;
+        w->pending--;
+        taskEXIT_CRITICAL(&s_mux);
+
+        if (!stale)
+            TRACE(TRACE_EFFECT_END, w - s_workers, cancelled);
+    }
+}
+
+esp_err_t effect_pool_init(void)
+{
+    for (int i = 0; i < EFFECT_CHANNEL_COUNT; i++)
+    {
+        effect_worker_t *w = &s_workers[i];
+        w->name = WORKER_NAMES[i];
+        w->queue = xQueueCreateStatic(EFFECT_QUEUE_LENGTH, sizeof(effect_job_t), w->queue_storage, &w->queue_buf);
+        w->task = xTaskCreateStatic(effect_task, w->name, EFFECT_TASK_STACK_SIZE, w, EFFECT_TASK_PRIORITY, w->stack, &w->task_buf);
+        if (w->queue == NULL || w->task == NULL)
+        {
+            ESP_LOGE(TAG, "Failed to create %s", w->name);
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t post(effect_channel_t channel, effect_fn_t fn, effect_policy_t policy, TaskHandle_t waiter)
+{
+    if (channel >= EFFECT_CHANNEL_COUNT || fn == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    effect_worker_t *w = &s_workers[channel];
+    if (w->queue == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    effect_job_t job = {.fn = fn, .generation = 0, .waiter = waiter};
+    bool busy = false;
+    bool replaced = false;
+
+    taskENTER_CRITICAL(&s_mux);
+    w->stats.posted++;
+    if (policy == EFFECT_IF_IDLE && w->pending > 0)
+    {
+        busy = true;
+        w->stats.rejected++;
+    }
+    else
+    {
+        if (policy == EFFECT_REPLACE && w->pending > 0)
+        {
+            w->generation++;
+            replaced = true;
+        }
+        job.generation = w->generation;
+        w->pending++;
+    }
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (busy)
+        return ESP_ERR_INVALID_STATE;
+
+    // Cut the running effect's sleep short; queued stale jobs are skipped
+    if (replaced)
+        xTaskNotifyGive(w->task);
+
+    if (xQueueSend(w->queue, &job, 0) != pdTRUE)
+    {
+        taskENTER_CRITICAL(&s_mux);
+        w->pending--;
+        w->stats.rejected++;
+        taskEXIT_CRITICAL(&s_mux);
+        ESP_LOGW(TAG, "%s queue full", w->name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t effect_post(effect_channel_t channel, effect_fn_t fn, effect_policy_t policy)
+{
+    return post(channel, fn, policy, NULL);
+}
+
+esp_err_t effect_post_wait(effect_channel_t channel, effect_fn_t fn, effect_policy_t policy,
+                           uint32_t timeout_ms, int64_t *started_us)
+{
+    // Drop a start time left over from an earlier wait that timed out
+    xTaskNotifyStateClear(NULL);
+
+    esp_err_t err = post(channel, fn, policy, xTaskGetCurrentTaskHandle());
+    if (err != ESP_OK)
+        return err;
+
+    uint32_t started = 0;
+    if (xTaskNotifyWait(0, UINT32_MAX, &started, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    // The worker sends the low 32 bits; the start was less than 71 min ago
+    if (started_us != NULL)
+    {
+        int64_t now = esp_timer_get_time();
+        *started_us = now - (uint32_t)((uint32_t)now - started);
+    }
+    return ESP_OK;
+}
+
+void effect_cancel(effect_channel_t channel)
+{
+    if (channel >= EFFECT_CHANNEL_COUNT || s_workers[channel].task == NULL)
+        return;
+
+    effect_worker_t *w = &s_workers[channel];
+    taskENTER_CRITICAL(&s_mux);
+    bool busy = w->pending > 0;
+    if (busy)
+        w->generation++;
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (busy)
+        xTaskNotifyGive(w->task);
+}
+
+bool effect_cancelled(void)
+{
+    effect_worker_t *w = current_worker();
+    if (w == NULL)
+        return false;
+
+    taskENTER_CRITICAL(&s_mux);
+    bool cancelled = w->running != w->generation;
+    taskEXIT_CRITICAL(&s_mux);
+    return cancelled;
+}
+
+bool effect_sleep_ms(uint32_t ms)
+{
+    if (current_worker() == NULL)
+    {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+        return true;
+    }
+
+    if (effect_cancelled())
+        return false;
+    // Only a cancel notifies the worker
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms));
+    return !effect_cancelled();
+}
+
+void effect_get_stats(effect_channel_t channel, effect_stats_t *stats)
+{
+    if (channel >= EFFECT_CHANNEL_COUNT || stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&s_mux);
+    *stats = s_workers[channel].stats;
+    taskEXIT_CRITICAL(&s_mux);
+}
@@ -0,0 +1,192 @@
+#include "game_mode.h"
+#include "button_manager.h"
+#include "buzzer_manager.h"
+#include "command_table.h"
+#include "cue_scheduler.h"
+#include "effect_pool.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "static_alloc.h"
+#include "trace.h"
+#include "esp_timer.h"
+
+static const char *TAG = "GAME_MODE";
+
+static const game_mode_profile_t MODE_PROFILES[GAME_MODE_COUNT] = {
+    // name        debounce set_mask mask             tones  flush  wifi                      log            enter_sound
+    {"BOARD",      200,     false,   BUTTON_MASK_ALL, true,  false, WIFI_PROFILE_BALANCED,    ESP_LOG_INFO,  NULL},
+    {"WAITING",    200,     true,    BUTTON_MASK_ALL, true,  false, WIFI_PROFILE_POWER_SAVE,  ESP_LOG_INFO,  buzzer_play_waiting},
+    {"MINIGAME",   50,      false,   BUTTON_MASK_ALL, false, true,  WIFI_PROFILE_LOW_LATENCY, ESP_LOG_WARN,  NULL},
+    {"REACTION",   50,      true,    BUTTON_MASK_ALL, false, true,  WIFI_PROFILE_LOW_LATENCY, ESP_LOG_WARN,  NULL},
+};
+
+// Transitions come from the MQTT worker, pins from any handler
+static SemaphoreHandle_t s_lock = NULL;
+STATIC_MUTEX_BUFFERS(s_lock);
+static volatile game_mode_t s_mode = GAME_MODE_BOARD;
+static bool s_wifi_pinned = false;
+
+static game_mode_transition_t s_history[GAME_MODE_HISTORY];
+static int s_history_head = 0;
+static int s_history_count = 0;
+
+static void enter_board(void) { game_mode_enter(GAME_MODE_BOARD); }
+static void enter_waiting(void) { game_mode_enter(GAME_MODE_WAITING); }
+static void enter_minigame(void) { game_mode_enter(GAME_MODE_MINIGAME); }
+static void enter_reaction(void) { game_mode_enter(GAME_MODE_REACTION); }
+
+static constexpr command_t STATUS_COMMANDS[] = {
+    {"BOARD", enter_board},
+    {"WAITING", enter_waiting},
+    {"MINIGAME", enter_minigame},
+    {"REACTION", enter_reaction},
+};
+static constexpr CommandTable s_status_commands(STATUS_COMMANDS);
+static_assert(s_status_commands.is_perfect(), "Status names must be unique");
+
+/**
+ * Apply a profile; call with s_lock held
+ */
+static void apply_profile(const game_mode_profile_t *profile)
+{
+    if (profile->set_mask)
+    {
+        button_set_filter((button_active_mask_t)profile->button_mask, profile->debounce_ms);
+    }
+    else
+    {
+        button_set_debounce_time(profile->debounce_ms);
+    }
+    if (!s_wifi_pinned)
+    {
+        wifi_set_latency_profile(profile->wifi_profile);
+    }
+    esp_log_level_set("*", profile->log_level);
+}
+
+esp_err_t game_mode_init(void)
+{
+    s_lock = STATIC_MUTEX_CREATE(s_lock);
+    if (s_lock == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    apply_profile(&MODE_PROFILES[s_mode]);
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+void game_mode_handle_status(const char *status, int len)
+{
+    if (!s_status_commands.dispatch(status, len))
+    {
+        game_mode_enter(GAME_MODE_BOARD);
+    }
+}
+
+esp_err_t game_mode_enter(game_mode_t mode)
+{
+    if (mode >= GAME_MODE_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_lock == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t start = esp_timer_get_time();
+    const game_mode_profile_t *profile = &MODE_PROFILES[mode];
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    game_mode_t from = s_mode;
+    if (from != mode && MODE_PROFILES[from].flush_on_exit)
+    {
+        button_flush_queue();
+        effect_cancel(EFFECT_CHANNEL_SEQUENCE);
+        cue_cancel_all();
+    }
+    apply_profile(profile);
+    s_mode = mode;
+
+    uint32_t apply_us = (uint32_t)(esp_timer_get_time() - start);
+    if (from != mode)
+    {
+        game_mode_transition_t *t = &s_history[s_history_head];
+        t->from = from;
+        t->to = mode;
+        t->at_us = start;
+        t->apply_us = apply_us;
+        s_history_head = (s_history_head + 1) % GAME_MODE_HISTORY;
+        if (s_history_count < GAME_MODE_HISTORY)
+            s_history_count++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (from != mode)
+    {
+        TRACE(TRACE_MODE, from, mode);
+        // Logged at WARN so it still shows under the quiet profiles
+        ESP_LOGW(TAG, "%s -> %s in %lu us", MODE_PROFILES[from].name, profile->name, (unsigned long)apply_us);
+    }
+
+    if (profile->enter_sound != NULL)
+    {
+        effect_post(EFFECT_CHANNEL_SOUND, profile->enter_sound, EFFECT_REPLACE);
+    }
+    return ESP_OK;
+}
+
+game_mode_t game_mode_get(void)
+{
+    return s_mode;
+}
+
+const game_mode_profile_t *game_mode_profile(void)
+{
+    return &MODE_PROFILES[s_mode];
+}
+
+int game_mode_get_transitions(game_mode_transition_t *out, int max)
+{
+    if (out == NULL || max <= 0 || s_lock == NULL)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int count = s_history_count < max ? s_history_count : max;
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = s_history[(s_history_head - 1 - i + GAME_MODE_HISTORY) % GAME_MODE_HISTORY];
+    }
+    xSemaphoreGive(s_lock);
+    return count;
+}
+
+void game_mode_pin_wifi_profile(wifi_latency_profile_t profile)
+{
+    if (s_lock == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_wifi_pinned = true;
+    wifi_set_latency_profile(profile);
+    xSemaphoreGive(s_lock);
+}
+
+void game_mode_unpin_wifi_profile(void)
+{
+    if (s_lock == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_wifi_pinned = false;
+    wifi_set_latency_profile(MODE_PROFILES[s_mode].wifi_profile);
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,124 @@
+#include "heap_guard.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_log.h"
+
+static const char *TAG = "HEAP_GUARD";
+
+static const char *const FIRMWARE_TASKS[] = {
+    "main", "mqtt_worker", "outbox", "clock_sync", "cue", "telemetry", "fx_sound", "fx_sequence"};
+#define FIRMWARE_TASK_COUNT (sizeof(FIRMWARE_TASKS) / sizeof(FIRMWARE_TASKS[0]))
+
+// The hooks run inside malloc/free on any core, in tasks and ISRs
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_firmware[FIRMWARE_TASK_COUNT];
+// heap_guard_pause() depth per firmware task; only that task writes its slot
+static volatile uint8_t s_paused[FIRMWARE_TASK_COUNT];
+static volatile bool s_armed = false;
+static heap_guard_stats_t s_stats;
+static TaskHandle_t s_last_task = NULL;
+
+/**
+ * Get a task's slot in FIRMWARE_TASKS
+ * @return The index, or -1 for other tasks
+ */
+static int IRAM_ATTR firmware_index(TaskHandle_t task)
+{
+    for (size_t i = 0; i < FIRMWARE_TASK_COUNT; i++)
+    {
+        if (s_firmware[i] == task)
+            return (int)i;
+    }
+    return -1;
+}
+
+#if CONFIG_HEAP_USE_HOOKS
+
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (!s_armed || ptr == NULL)
+        return;
+
+    TaskHandle_t task = xPortInIsrContext() ? NULL : xTaskGetCurrentTaskHandle();
+    int index = task != NULL ? firmware_index(task) : -1;
+    bool firmware = index >= 0 && s_paused[index] == 0;
+
+    portENTER_CRITICAL_SAFE(&s_mux);
+    s_stats.allocs++;
+    s_stats.bytes += size;
+    if (firmware)
+    {
+        s_stats.firmware_allocs++;
+        s_stats.firmware_bytes += size;
+        s_stats.last_size = size;
+        s_last_task = task;
+    }
+    portEXIT_CRITICAL_SAFE(&s_mux);
+
+#if HEAP_GUARD_ABORT
+    if (firmware)
+        esp_system_abort("Heap allocation by a firmware task after boot");
+#endif
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+    if (!s_armed || ptr == NULL)
+        return;
+
+    portENTER_CRITICAL_SAFE(&s_mux);
+    s_stats.frees++;
+    portEXIT_CRITICAL_SAFE(&s_mux);
+}
+#endif
+
+void heap_guard_arm(void)
+{
+    for (size_t i = 0; i < FIRMWARE_TASK_COUNT; i++)
+    {
+        s_firmware[i] = xTaskGetHandle(FIRMWARE_TASKS[i]);
+    }
+
+    taskENTER_CRITICAL(&s_mux);
+    s_stats = {};
+    s_stats.armed = true;
+    s_last_task = NULL;
+    taskEXIT_CRITICAL(&s_mux);
+    s_armed = true;
+
+#if CONFIG_HEAP_USE_HOOKS
+    ESP_LOGI(TAG, "Counting heap allocations (%lu B free, largest block %lu B)",
+             (unsigned long)heap_caps_get_free_size(MALLOC_CAP_DEFAULT),
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+#else
+    ESP_LOGW(TAG, "CONFIG_HEAP_USE_HOOKS is off, allocations are not counted");
+#endif
+}
+
+void heap_guard_pause(void)
+{
+    int index = firmware_index(xTaskGetCurrentTaskHandle());
+    if (index >= 0)
+        s_paused[index]++;
+}
+
+void heap_guard_resume(void)
+{
+    int index = firmware_index(xTaskGetCurrentTaskHandle());
+    if (index >= 0 && s_paused[index] > 0)
+        s_paused[index]--;
+}
+
+void heap_guard_get_stats(heap_guard_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&s_mux);
+    *stats = s_stats;
+    TaskHandle_t last = s_last_task;
+    taskEXIT_CRITICAL(&s_mux);
+    stats->last_task = last != NULL ? pcTaskGetName(last) : NULL;
+}
@@ -0,0 +1,69 @@
+#include "json_arena.h"
+#include "bump_arena.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <stdlib.h>
+
+static const char *TAG = "JSON_ARENA";
+
+alignas(BumpArena::ALIGN) static uint8_t s_buffer[JSON_ARENA_SIZE];
+static BumpArena s_arena(s_buffer, sizeof(s_buffer));
+
+// Only the owner allocates from the arena; everyone may free into it
+static TaskHandle_t s_owner = NULL;
+static json_arena_stats_t s_stats = {.size = JSON_ARENA_SIZE};
+static bool s_overflow_logged = false;
+
+static void *arena_malloc(size_t size)
+{
+    if (s_owner != NULL && xTaskGetCurrentTaskHandle() == s_owner)
+    {
+        void *block = s_arena.alloc(size);
+        if (block != NULL)
+            return block;
+        s_stats.overflows++;
+    }
+    return malloc(size);
+}
+
+static void arena_free(void *ptr)
+{
+    // Arena blocks go back all at once in json_arena_end()
+    if (!s_arena.owns(ptr))
+        free(ptr);
+}
+
+void json_arena_init(void)
+{
+    cJSON_Hooks hooks = {};
+    hooks.malloc_fn = arena_malloc;
+    hooks.free_fn = arena_free;
+    cJSON_InitHooks(&hooks);
+}
+
+void json_arena_begin(void)
+{
+    s_owner = xTaskGetCurrentTaskHandle();
+}
+
+void json_arena_end(void)
+{
+    s_owner = NULL;
+    s_arena.reset();
+    s_stats.messages++;
+    s_stats.high_water = s_arena.high_water();
+
+    if (s_stats.overflows > 0 && !s_overflow_logged)
+    {
+        s_overflow_logged = true;
+        ESP_LOGW(TAG, "Message did not fit in %d B, raise JSON_ARENA_SIZE", JSON_ARENA_SIZE);
+    }
+}
+
+void json_arena_get_stats(json_arena_stats_t *stats)
+{
+    if (stats != NULL)
+        *stats = s_stats;
+}
@@ -3,6 +3,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include "hd44780.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "static_alloc.h"
 #include "esp_log.h"
 
 static const char *TAG = "LCD";
@@ -22,13 +25,52 @@ static bool display_on = true;
 static bool cursor_on = false;
 static bool blink_on = false;
 
-// Update display control settings
+// Back buffer: what the rows currently show, valid only after lcd_show_frame
+static lcd_frame_t s_front;
+static bool s_front_valid = false;
+
+// main, the MQTT worker and the sequence worker all draw; every public call
+// holds this so the cursor, the rows and the back buffer stay together
+static SemaphoreHandle_t s_lock = NULL;
+STATIC_MUTEX_BUFFERS(s_lock);
+
+// Update display control settings; call with s_lock held
 static void update_display_control(void)
 {
-    if (lcd_initialized)
+    hd44780_control(&lcd_dev, display_on, cursor_on, blink_on);
+}
+
+// Helpers below expect s_lock held and the LCD initialized
+static void set_cursor(uint8_t col, uint8_t row)
+{
+    if (col >= LCD_COLS)
+        col = LCD_COLS - 1;
+    if (row >= LCD_ROWS)
+        row = LCD_ROWS - 1;
+    hd44780_gotoxy(&lcd_dev, col, row);
+}
+
+static void print(const char *str)
+{
+    s_front_valid = false;
+    hd44780_puts(&lcd_dev, str);
+}
+
+static void show_frame(const lcd_frame_t *frame)
+{
+    for (uint8_t row = 0; row < LCD_ROWS; row++)
     {
-        hd44780_control(&lcd_dev, display_on, cursor_on, blink_on);
+        if (s_front_valid && strcmp(s_front.lines[row], frame->lines[row]) == 0)
+            continue;
+
+        // Pad to full width so stale characters are overwritten without a clear
+        char padded[LCD_COLS + 1];
+        snprintf(padded, sizeof(padded), "%-*.*s", LCD_COLS, LCD_COLS, frame->lines[row]);
+        hd44780_gotoxy(&lcd_dev, 0, row);
+        hd44780_puts(&lcd_dev, padded);
+        strlcpy(s_front.lines[row], frame->lines[row], sizeof(s_front.lines[row]));
     }
+    s_front_valid = true;
 }
 
 esp_err_t lcd_init(void)
@@ -39,6 +81,14 @@ esp_err_t lcd_init(void)
         return ESP_OK;
     }
 
+    if (s_lock == NULL)
+        s_lock = STATIC_MUTEX_CREATE(s_lock);
+    if (s_lock == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create lock");
+        return ESP_FAIL;
+    }
+
     ESP_LOGI(TAG, "Initializing LCD...");
     ESP_LOGI(TAG, "  RS=GPIO%d, E=GPIO%d", LCD_RS, LCD_E);
     ESP_LOGI(TAG, "  D4=GPIO%d, D5=GPIO%d, D6=GPIO%d, D7=GPIO%d",
@@ -65,14 +115,14 @@ esp_err_t lcd_init(void)
         return err;
     }
 
-    lcd_initialized = true;
-
     // Set default display state: on, no cursor, no blink
     display_on = true;
     cursor_on = false;
     blink_on = false;
     update_display_control();
 
+    lcd_initialized = true;
+
     ESP_LOGI(TAG, "LCD initialized successfully");
     return ESP_OK;
 }
@@ -81,38 +131,48 @@ void lcd_clear(void)
 {
     if (!lcd_initialized)
         return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_front_valid = false;
     hd44780_clear(&lcd_dev);
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_home(void)
 {
     if (!lcd_initialized)
         return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
     hd44780_gotoxy(&lcd_dev, 0, 0);
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_set_cursor(uint8_t col, uint8_t row)
 {
     if (!lcd_initialized)
         return;
-    if (col >= LCD_COLS)
-        col = LCD_COLS - 1;
-    if (row >= LCD_ROWS)
-        row = LCD_ROWS - 1;
-    hd44780_gotoxy(&lcd_dev, col, row);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    set_cursor(col, row);
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_print(const char *str)
 {
     if (!lcd_initialized || !str)
         return;
-    hd44780_puts(&lcd_dev, str);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    print(str);
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_print_at(uint8_t col, uint8_t row, const char *str)
 {
-    lcd_set_cursor(col, row);
-    lcd_print(str);
+    if (!lcd_initialized || !str)
+        return;
+    // One hold, so another task cannot move the cursor in between
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    set_cursor(col, row);
+    print(str);
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_printf(const char *fmt, ...)
@@ -145,31 +205,47 @@ void lcd_printf_at(uint8_t col, uint8_t row, const char *fmt, ...)
 
 void lcd_show_message(const char *line1, const char *line2)
 {
-    lcd_clear();
-    if (line1)
-    {
-        lcd_print_at(0, 0, line1);
-    }
-    if (line2)
-    {
-        lcd_print_at(0, 1, line2);
-    }
+    lcd_frame_t frame;
+    strlcpy(frame.lines[0], line1 ? line1 : "", sizeof(frame.lines[0]));
+    strlcpy(frame.lines[1], line2 ? line2 : "", sizeof(frame.lines[1]));
+    lcd_show_frame(&frame);
+}
+
+void lcd_show_frame(const lcd_frame_t *frame)
+{
+    if (!lcd_initialized || !frame)
+        return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    show_frame(frame);
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_display_on(bool on)
 {
+    if (!lcd_initialized)
+        return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
     display_on = on;
     update_display_control();
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_cursor_on(bool show)
 {
+    if (!lcd_initialized)
+        return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
     cursor_on = show;
     update_display_control();
+    xSemaphoreGive(s_lock);
 }
 
 void lcd_blink_on(bool blink)
 {
+    if (!lcd_initialized)
+        return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
     blink_on = blink;
     update_display_control();
+    xSemaphoreGive(s_lock);
 }
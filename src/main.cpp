@@ -2,8 +2,8 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
-#include "cJSON.h"
 #include "esp_timer.h"
 #include "lcd_manager.h"
 #include "wifi_manager.h"
@@ -11,164 +11,166 @@
 #include "buzzer_manager.h"
 #include "button_manager.h"
 #include "led_manager.h"
+#include "display_parser.h"
+#include "button_outbox.h"
+#include "clock_sync.h"
+#include "cue_scheduler.h"
+#include "reaction_mode.h"
+#include "telemetry.h"
+#include "profiler.h"
+#include "boot_sequence.h"
+#include "game_mode.h"
+#include "effect_pool.h"
+#include "command_table.h"
+#include "static_alloc.h"
+#include "heap_guard.h"
+#include "trace.h"
 
 static const char *TAG = "MAIN";
 
 void perform_traffic_light_countdown(void);
-void countdown_task_wrapper(void *pvParameters);
-
-static TaskHandle_t s_countdown_task_handle = NULL;
 
 //------------------------------------------------------------------------------
 // JSON Handler
 //------------------------------------------------------------------------------
-static bool s_has_received_display = false;
+static void post_display(const display_update_t *update);
 
-void handle_display_message(const char *payload)
+void handle_display_message(const char *payload, int len)
 {
-    s_has_received_display = true;
-
-    cJSON *root = cJSON_Parse(payload);
-    if (root == NULL)
+    display_update_t update;
+    if (mqtt_wire_is_binary(WIRE_TOPIC_DISPLAY) && wire_is_binary(payload, len))
+    {
+        if (wire_decode_display((const uint8_t *)payload, len, &update) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to decode binary Display Message");
+            return;
+        }
+    }
+    else if (display_parse(payload, len, &update) != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to parse JSON Display Message");
         return;
     }
 
-    cJSON *line1_item = cJSON_GetObjectItem(root, "line1");
-    cJSON *line2_item = cJSON_GetObjectItem(root, "line2");
+    // The main task draws it, so it cannot race the idle animation
+    post_display(&update);
 
-    if (line1_item || line2_item)
-    {
-        const char *l1 = (line1_item && cJSON_IsString(line1_item)) ? line1_item->valuestring : "";
-        const char *l2 = (line2_item && cJSON_IsString(line2_item)) ? line2_item->valuestring : "";
-        lcd_show_message(l1, l2);
-    }
-    else
+    if (update.has_buttons)
     {
-        cJSON *msg_item = cJSON_GetObjectItem(root, "message");
-        if (!msg_item || !cJSON_IsString(msg_item))
-        {
-            msg_item = cJSON_GetObjectItem(root, "msg");
-        }
-        if (msg_item && cJSON_IsString(msg_item))
-        {
-            lcd_show_message(msg_item->valuestring, "");
-        }
+        button_set_active_mask((button_active_mask_t)update.button_mask);
     }
 
-    cJSON *btns_item = cJSON_GetObjectItem(root, "buttons");
-    if (btns_item && cJSON_IsArray(btns_item))
-    {
-        uint8_t mask = BUTTON_MASK_NONE;
-        int count = cJSON_GetArraySize(btns_item);
-        for (int i = 0; i < count; i++)
-        {
-            cJSON *btn = cJSON_GetArrayItem(btns_item, i);
-            if (btn && cJSON_IsNumber(btn))
-            {
-                int btn_id = btn->valueint;
-                if (btn_id == 1)
-                    mask |= BUTTON_MASK_1;
-                else if (btn_id == 2)
-                    mask |= BUTTON_MASK_2;
-                else if (btn_id == 3)
-                    mask |= BUTTON_MASK_3;
-            }
-        }
-        button_set_active_mask((button_active_mask_t)mask);
-    }
-
-    cJSON_Delete(root);
     mqtt_publish_ack();
 }
 
 //------------------------------------------------------------------------------
-// MQTT Callback
+// Command Tables
 //------------------------------------------------------------------------------
 
-static bool s_minigame_active = false;
+// A repeated start while the countdown runs is ignored
+static void start_countdown(void)
+{
+    effect_post(EFFECT_CHANNEL_SEQUENCE, perform_traffic_light_countdown, EFFECT_IF_IDLE);
+}
+
+static constexpr command_t SOUND_COMMANDS[] = {
+    {"WIN", buzzer_play_game_finish},
+    {"LOSE", buzzer_play_damage},
+    {"ROLL", buzzer_play_dice_roll},
+    {"START", buzzer_play_game_start},
+    {"MOVE", buzzer_play_move},
+    {"HEAL", buzzer_play_minigame_finish},
+    {"ERROR", buzzer_play_error},
+    {"DAMAGE", buzzer_play_damage},
+    {"SIGNAL", buzzer_play_reaction_signal},
+    {"MINIGAME_START", start_countdown},
+    {"REACTION", reaction_fire_stimulus},
+};
+static constexpr CommandTable s_sound_commands(SOUND_COMMANDS);
+static_assert(s_sound_commands.is_perfect(), "Sound command names must be unique");
+
+//------------------------------------------------------------------------------
+// Radio latency profile: follows the game mode unless the server pins one
+//------------------------------------------------------------------------------
+static void pin_low_latency(void) { game_mode_pin_wifi_profile(WIFI_PROFILE_LOW_LATENCY); }
+static void pin_balanced(void) { game_mode_pin_wifi_profile(WIFI_PROFILE_BALANCED); }
+static void pin_power_save(void) { game_mode_pin_wifi_profile(WIFI_PROFILE_POWER_SAVE); }
+
+static constexpr command_t WIFI_PROFILE_COMMANDS[] = {
+    {"LOW_LATENCY", pin_low_latency},
+    {"BALANCED", pin_balanced},
+    {"POWER_SAVE", pin_power_save},
+    {"AUTO", game_mode_unpin_wifi_profile},
+};
+static constexpr CommandTable s_wifi_profile_commands(WIFI_PROFILE_COMMANDS);
+static_assert(s_wifi_profile_commands.is_perfect(), "Profile names must be unique");
 
 //------------------------------------------------------------------------------
-// MQTT Callback
+// MQTT Handlers
 //------------------------------------------------------------------------------
-void on_mqtt_message(const char *topic, const char *payload, int len)
+void on_display_message(const char *topic, int topic_len, const char *payload, int len, void *ctx)
 {
-    ESP_LOGI(TAG, "MQTT Message: %s -> %s", topic, payload);
+    TRACE(TRACE_DISPLAY, len, 0);
+    handle_display_message(payload, len);
+}
 
-    if (strcmp(topic, MQTT_TOPIC_DISPLAY) == 0)
+/**
+ * Play a sound on the effect pool, cutting off whatever was playing
+ * @return true if the name is a known sound
+ */
+static bool play_sound(const char *name, size_t len)
+{
+    const command_t *cmd = s_sound_commands.find(name, len);
+    if (cmd == NULL)
     {
-        handle_display_message(payload);
+        return false;
     }
-    else if (strcmp(topic, MQTT_TOPIC_SOUND) == 0)
+    effect_post(EFFECT_CHANNEL_SOUND, cmd->handler, EFFECT_REPLACE);
+    return true;
+}
+
+void on_sound_message(const char *topic, int topic_len, const char *payload, int len, void *ctx)
+{
+    if (!play_sound(payload, len))
     {
-        if (strcmp(payload, "WIN") == 0)
-            buzzer_play_game_finish();
-        else if (strcmp(payload, "LOSE") == 0)
-            buzzer_play_damage();
-        else if (strcmp(payload, "ROLL") == 0)
-            buzzer_play_dice_roll();
-        else if (strcmp(payload, "START") == 0)
-            buzzer_play_game_start();
-        else if (strcmp(payload, "MOVE") == 0)
-            buzzer_play_move();
-        else if (strcmp(payload, "MOVE") == 0)
-            buzzer_play_move();
-        else if (strcmp(payload, "HEAL") == 0)
-            buzzer_play_minigame_finish();
-        else if (strcmp(payload, "ERROR") == 0)
-            buzzer_play_error();
-        else if (strcmp(payload, "DAMAGE") == 0)
-            buzzer_play_damage();
-        else if (strcmp(payload, "SIGNAL") == 0)
-            buzzer_play_reaction_signal();
-        else if (strcmp(payload, "MINIGAME_START") == 0)
-        {
-            if (s_countdown_task_handle == NULL)
-            {
-                xTaskCreate(countdown_task_wrapper, "countdown", 2048, NULL, 5, &s_countdown_task_handle);
-            }
-        }
-        else
-        {
-            if (s_countdown_task_handle == NULL)
-            {
-                xTaskCreate(countdown_task_wrapper, "countdown", 2048, NULL, 5, &s_countdown_task_handle);
-            }
-        }
+        ESP_LOGW(TAG, "Unknown sound: %.*s", len, payload);
     }
-    else if (strcmp(topic, MQTT_TOPIC_STATUS) == 0)
-    {
-        ESP_LOGI(TAG, "Game Status: %s", payload);
+}
 
-        if (strcmp(payload, "MINIGAME") == 0)
-        {
-            s_minigame_active = true;
-            button_set_debounce_time(50);
-            ESP_LOGI(TAG, "Minigame Mode: ON (Debounce 50ms, Sound Muted)");
-        }
-        else
-        {
-            if (s_minigame_active)
-            {
-                button_flush_queue();
-                ESP_LOGI(TAG, "Exiting Minigame: Queue Flushed");
-            }
-            s_minigame_active = false;
+void on_wifi_profile_message(const char *topic, int topic_len, const char *payload, int len, void *ctx)
+{
+    if (!s_wifi_profile_commands.dispatch(payload, len))
+    {
+        ESP_LOGW(TAG, "Unknown WiFi profile: %.*s", len, payload);
+    }
+}
 
-            if (strcmp(payload, "WAITING") == 0)
-            {
-                ESP_LOGI(TAG, "Game Waiting - Playing Tune");
-                button_set_debounce_time(200);
-                buzzer_play_waiting();
-            }
-            else
-            {
-                button_set_debounce_time(200);
-                ESP_LOGI(TAG, "Debounce set to 200ms (Standard)");
-            }
-        }
+/**
+ * Play a cue and report when its effect started
+ * MINIGAME_START goes straight to the sequence worker rather than through
+ * start_countdown, so a countdown already running refuses the cue and the
+ * start time is the countdown's own.
+ */
+static esp_err_t fire_cue(const char *cue, size_t len, int64_t *started_us)
+{
+    const command_t *cmd = s_sound_commands.find(cue, len);
+    if (cmd == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
     }
+    if (cmd->handler == start_countdown)
+    {
+        return effect_post_wait(EFFECT_CHANNEL_SEQUENCE, perform_traffic_light_countdown, EFFECT_IF_IDLE,
+                                CUE_START_TIMEOUT_MS, started_us);
+    }
+    return effect_post_wait(EFFECT_CHANNEL_SOUND, cmd->handler, EFFECT_REPLACE, CUE_START_TIMEOUT_MS, started_us);
+}
+
+void on_status_message(const char *topic, int topic_len, const char *payload, int len, void *ctx)
+{
+    ESP_LOGI(TAG, "Game Status: %.*s", len, payload);
+
+    game_mode_handle_status(payload, len);
 }
 
 //------------------------------------------------------------------------------
@@ -181,23 +183,20 @@ void on_mqtt_message(const char *topic, const char *payload, int len)
 //------------------------------------------------------------------------------
 void perform_traffic_light_countdown(void)
 {
-    lcd_show_message("Get Ready...", "3");
-    led_set_red(true);
-    buzzer_tone(NOTE_C5, 100);
-    vTaskDelay(pdMS_TO_TICKS(900));
-    led_set_red(false);
-
-    lcd_show_message("Get Ready...", "2");
-    led_set_yellow(true);
-    buzzer_tone(NOTE_C5, 100);
-    vTaskDelay(pdMS_TO_TICKS(900));
-    led_set_yellow(false);
-
-    lcd_show_message("Get Ready...", "1");
-    led_set_green(true);
-    buzzer_tone(NOTE_C5, 100);
-    vTaskDelay(pdMS_TO_TICKS(900));
-    led_set_green(false);
+    static const char *const COUNTS[] = {"3", "2", "1"};
+
+    for (int i = 0; i < 3; i++)
+    {
+        lcd_show_message("Get Ready...", COUNTS[i]);
+        led_set_all(i == 0, i == 1, i == 2);
+        buzzer_tone(NOTE_C5, 100);
+        if (!effect_sleep_ms(900))
+        {
+            // Cancelled by a mode change
+            led_set_all(false, false, false);
+            return;
+        }
+    }
 
     lcd_show_message("GO!", "");
     led_set_all(true, true, true);
@@ -206,137 +205,314 @@ void perform_traffic_light_countdown(void)
 }
 
 //------------------------------------------------------------------------------
-// Non-blocking countdown task wrapper
+// Main event loop: one queue set for button events and everything else
 //------------------------------------------------------------------------------
-void countdown_task_wrapper(void *pvParameters)
+typedef enum
+{
+    MAIN_EVENT_CONNECTED,
+    MAIN_EVENT_DISCONNECTED,
+    MAIN_EVENT_ANIM_TICK,
+    MAIN_EVENT_REACTION_ARMED,
+    MAIN_EVENT_REACTION_TICK,
+} main_event_t;
+
+#define MAIN_EVENT_QUEUE_LENGTH 8
+#define DISPLAY_MAILBOX_LENGTH 1
+#define ANIM_INTERVAL_MS 500
+#define REACTION_POLL_MS 50
+
+static QueueHandle_t s_main_events = NULL;
+STATIC_QUEUE_BUFFERS(s_main_events, MAIN_EVENT_QUEUE_LENGTH, sizeof(uint8_t));
+// Latest display message for the main task; a newer one overwrites it
+typedef struct
+{
+    bool has_text;
+    lcd_frame_t frame;
+} display_mail_t;
+static QueueHandle_t s_display_mailbox = NULL;
+STATIC_QUEUE_BUFFERS(s_display_mailbox, DISPLAY_MAILBOX_LENGTH, sizeof(display_mail_t));
+static QueueSetHandle_t s_main_set = NULL;
+static esp_timer_handle_t s_anim_timer = NULL;
+static esp_timer_handle_t s_reaction_timer = NULL;
+static bool s_online = false; // MQTT has connected at least once
+static bool s_has_received_display = false;
+
+// Animation state, only touched by the main task
+static const char *s_anim_title = NULL;
+static int s_anim_frame = 0;
+
+static void post_main_event(main_event_t event)
+{
+    uint8_t value = (uint8_t)event;
+    if (s_main_events != NULL)
+    {
+        // Events are idempotent, so a full queue loses nothing that matters
+        xQueueSend(s_main_events, &value, 0);
+    }
+}
+
+static void post_display(const display_update_t *update)
 {
-    perform_traffic_light_countdown();
-    s_countdown_task_handle = NULL;
-    vTaskDelete(NULL);
+    display_mail_t mail = {.has_text = update->has_text, .frame = update->frame};
+    if (s_display_mailbox != NULL)
+    {
+        xQueueOverwrite(s_display_mailbox, &mail);
+    }
 }
 
-extern "C" void app_main(void)
+static void post_timer_event(void *arg)
 {
-    ESP_LOGI(TAG, "Starting Application...");
+    post_main_event((main_event_t)(uintptr_t)arg);
+}
 
-    lcd_init();
-    buzzer_init();
-    button_init();
-    led_init();
+/**
+ * Create the main loop's event queue and queue set
+ * Runs before anything can post: FreeRTOS refuses to add a queue that is
+ * not empty, and a missed add would leave the loop deaf to that queue.
+ */
+static esp_err_t create_main_events(void)
+{
+    s_main_events = STATIC_QUEUE_CREATE(s_main_events, MAIN_EVENT_QUEUE_LENGTH, sizeof(uint8_t));
+    s_display_mailbox = STATIC_QUEUE_CREATE(s_display_mailbox, DISPLAY_MAILBOX_LENGTH, sizeof(display_mail_t));
+    // FreeRTOS has no static queue set; this is the one firmware object left on the heap
+    s_main_set = xQueueCreateSet(BUTTON_QUEUE_LENGTH + MAIN_EVENT_QUEUE_LENGTH + DISPLAY_MAILBOX_LENGTH);
+    if (s_main_events == NULL || s_display_mailbox == NULL || s_main_set == NULL)
+        return ESP_ERR_NO_MEM;
+    if (xQueueAddToSet(s_main_events, s_main_set) != pdPASS ||
+        xQueueAddToSet(s_display_mailbox, s_main_set) != pdPASS)
+        return ESP_FAIL;
+    return ESP_OK;
+}
 
-    lcd_show_message("Connecting to", "WiFi...");
-    wifi_init_sta();
+static void on_connection_change(bool connected)
+{
+    post_main_event(connected ? MAIN_EVENT_CONNECTED : MAIN_EVENT_DISCONNECTED);
+}
+
+static void on_reaction_armed(void)
+{
+    post_main_event(MAIN_EVENT_REACTION_ARMED);
+}
 
-    if (wifi_get_status() == WIFI_STATUS_CONNECTED)
+/**
+ * Run the idle animation timer only while there is nothing better on screen
+ */
+static void update_animation(void)
+{
+    bool wanted = !s_online || !mqtt_is_connected() || !s_has_received_display;
+    bool running = esp_timer_is_active(s_anim_timer);
+    if (wanted && !running)
     {
-        char ip[16];
-        wifi_get_ip(ip, sizeof(ip));
-        lcd_show_message("WiFi Connected!", ip);
+        s_anim_title = NULL;
+        esp_timer_start_periodic(s_anim_timer, (uint64_t)ANIM_INTERVAL_MS * 1000);
     }
-    else
+    else if (!wanted && running)
     {
-        lcd_show_message("WiFi Error", "Offline Mode");
+        esp_timer_stop(s_anim_timer);
     }
+}
 
-    vTaskDelay(pdMS_TO_TICKS(1500));
+/**
+ * Advance the dots; the title line is only rewritten when it changes
+ */
+static void draw_animation(void)
+{
+    static const char *const DOTS[] = {"   ", ".  ", ".. ", "..."};
 
-    lcd_show_message("Connecting to", "MQTT Broker...");
+    const char *title;
+    if (!s_online)
+    {
+        int64_t ip_us = boot_phase_time_us(BOOT_PHASE_WIFI);
+        if (ip_us == 0)
+            title = "Connecting WiFi";
+        else if (esp_timer_get_time() - ip_us > (int64_t)BOOT_MQTT_HINT_MS * 1000)
+            title = "MQTT Timeout";
+        else
+            title = "Connecting MQTT";
+    }
+    else if (!mqtt_is_connected())
+    {
+        title = "Reconnecting";
+    }
+    else
+    {
+        title = "Meeple's Gambit";
+    }
 
-    mqtt_set_message_callback(on_mqtt_message);
-    mqtt_manager_init();
+    s_anim_frame = (s_anim_frame + 1) % 4;
+    if (title != s_anim_title)
+    {
+        s_anim_title = title;
+        lcd_show_message(title, strcmp(title, "MQTT Timeout") == 0 ? "Check Broker IP" : DOTS[s_anim_frame]);
+    }
+    else if (strcmp(title, "MQTT Timeout") != 0)
+    {
+        lcd_print_at(0, 1, DOTS[s_anim_frame]);
+    }
+}
 
-    int retries = 0;
-    while (!mqtt_is_connected() && retries < 10)
+static void handle_press(uint8_t btn, int64_t press_us)
+{
+    // Reaction rounds time presses locally and publish once per round
+    if (reaction_handle_press(btn, press_us))
     {
-        vTaskDelay(pdMS_TO_TICKS(500));
-        retries++;
+        return;
     }
 
-    if (mqtt_is_connected())
+    if (game_mode_profile()->press_tones && btn >= 1 && btn <= 3)
     {
-        lcd_show_message("MQTT Connected!", "Ready...");
-        buzzer_play_minigame_start();
+        static const effect_fn_t PRESS_TONES[] = {
+            buzzer_play_tone_player_1, buzzer_play_tone_player_2, buzzer_play_tone_player_3};
+        effect_post(EFFECT_CHANNEL_SOUND, PRESS_TONES[btn - 1], EFFECT_REPLACE);
     }
-    else
+
+// 2. UI Feedback
+#if SHOW_DEBUG_UI
+    lcd_show_message("Button Pressed!", "Sending...");
+#endif
+
+    esp_err_t err = outbox_push(btn, press_us / 1000);
+    TRACE(TRACE_PRESS, btn, err);
+    if (err != ESP_OK)
     {
-        lcd_show_message("MQTT Timeout", "Check Broker IP");
-        vTaskDelay(pdMS_TO_TICKS(2000));
+        lcd_show_message("Outbox Full", "Press Dropped");
+        s_anim_title = NULL;
     }
+    else if (!mqtt_is_connected())
+    {
+        lcd_show_message("Offline", "Queued");
+        s_anim_title = NULL;
+    }
+}
 
-    lcd_show_message("Meeple's Gambit", "Press Button!");
+extern "C" void app_main(void)
+{
+    ESP_LOGI(TAG, "Starting Application...");
+    boot_mark(BOOT_PHASE_APP_MAIN);
+    ESP_ERROR_CHECK(create_main_events());
 
-    int64_t last_anim_time = 0;
-    int anim_frame = 0;
+    // The radio associates while the peripherals come up
+    boot_start_network();
+
+    lcd_init();
+    buzzer_init();
+    ESP_ERROR_CHECK(button_init(s_main_set));
+    led_init();
+    boot_mark(BOOT_PHASE_PERIPHERALS);
+
+    lcd_show_message("Connecting to", "WiFi...");
 
+    mqtt_register_handler(MQTT_TOPIC_DISPLAY, 1, on_display_message, NULL, 50);
+    mqtt_register_handler(MQTT_TOPIC_SOUND, 1, on_sound_message, NULL, 20);
+    mqtt_register_handler(MQTT_TOPIC_STATUS, 1, on_status_message, NULL, 50);
+    mqtt_register_handler(MQTT_TOPIC_WIFI_PROFILE, 1, on_wifi_profile_message, NULL, 20);
+    effect_pool_init();
+    mqtt_manager_init();
+    outbox_init();
+    clock_sync_init();
+    cue_scheduler_init(fire_cue);
+    game_mode_init();
+    reaction_init(on_reaction_armed);
+    profiler_init();
+    telemetry_init();
+    trace_init();
+    boot_connect_mqtt();
+    boot_mark(BOOT_PHASE_SERVICES);
+
+    esp_timer_create_args_t anim_args = {};
+    anim_args.callback = post_timer_event;
+    anim_args.arg = (void *)MAIN_EVENT_ANIM_TICK;
+    anim_args.name = "anim";
+    esp_timer_create(&anim_args, &s_anim_timer);
+    esp_timer_create_args_t reaction_args = {};
+    reaction_args.callback = post_timer_event;
+    reaction_args.arg = (void *)MAIN_EVENT_REACTION_TICK;
+    reaction_args.name = "reaction";
+    esp_timer_create(&reaction_args, &s_reaction_timer);
+
+    mqtt_add_connection_callback(on_connection_change);
+    update_animation();
+
+    // Presses are accepted from here on; the outbox holds them until MQTT is up
+    boot_mark(BOOT_PHASE_READY);
+    heap_guard_arm();
+
+    // Sleep until a press, a connection change, a display update or a timer
     while (1)
     {
-        if (mqtt_is_connected() && !s_has_received_display)
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(s_main_set, portMAX_DELAY);
+        if (member == button_get_queue())
         {
-            int64_t now = esp_timer_get_time() / 1000;
-            if (now - last_anim_time > 500)
+            uint8_t btn;
+            int64_t press_us;
+            if (button_get_event_at(&btn, &press_us, 0))
             {
-                last_anim_time = now;
-                anim_frame = (anim_frame + 1) % 4;
-                const char *dots = (anim_frame == 0) ? "" : (anim_frame == 1) ? "."
-                                                        : (anim_frame == 2)   ? ".."
-                                                                              : "...";
-                lcd_show_message("Meeple's Gambit", dots);
+                handle_press(btn, press_us);
             }
+            continue;
         }
-        else if (!mqtt_is_connected())
+
+        if (member == s_display_mailbox)
         {
-            int64_t now = esp_timer_get_time() / 1000;
-            if (now - last_anim_time > 500)
+            display_mail_t mail;
+            if (xQueueReceive(s_display_mailbox, &mail, 0) == pdTRUE)
             {
-                last_anim_time = now;
-                anim_frame = (anim_frame + 1) % 4;
-                const char *dots = (anim_frame == 0) ? "" : (anim_frame == 1) ? "."
-                                                        : (anim_frame == 2)   ? ".."
-                                                                              : "...";
-                lcd_show_message("Reconnecting", dots);
+                // Stop the animation first so it cannot draw over the frame
+                s_has_received_display = true;
+                update_animation();
+                if (mail.has_text)
+                {
+                    lcd_show_frame(&mail.frame);
+                }
             }
-            s_has_received_display = false;
-            vTaskDelay(pdMS_TO_TICKS(100));
             continue;
         }
 
-        uint8_t btn;
-        if (button_get_event(&btn, 100))
+        uint8_t event;
+        if (xQueueReceive(s_main_events, &event, 0) != pdTRUE)
         {
-            ESP_LOGI(TAG, "Button %d Pressed", btn);
+            continue;
+        }
 
-            if (!s_minigame_active)
+        switch (event)
+        {
+        case MAIN_EVENT_CONNECTED:
+            if (!s_online)
             {
-                button_play_tone(btn);
+                s_online = true;
+                // The tune no longer holds the loop, so go straight to the title
+                effect_post(EFFECT_CHANNEL_SOUND, buzzer_play_minigame_start, EFFECT_REPLACE);
+                lcd_show_message("Meeple's Gambit", "Press Button!");
             }
+            update_animation();
+            break;
 
-// 2. UI Feedback
-#if SHOW_DEBUG_UI
-            lcd_show_message("Button Pressed!", "Sending...");
-#endif
+        case MAIN_EVENT_DISCONNECTED:
+            s_has_received_display = false;
+            update_animation();
+            break;
 
-            if (mqtt_is_connected())
+        case MAIN_EVENT_ANIM_TICK:
+            // A tick queued before a display arrived must not draw over it
+            if (esp_timer_is_active(s_anim_timer))
             {
-                const char *player_id = "unknown";
-                if (btn == 1)
-                    player_id = "meeple_1";
-                else if (btn == 2)
-                    player_id = "meeple_2";
-                else if (btn == 3)
-                    player_id = "meeple_3";
-
-                int64_t ts = esp_timer_get_time() / 1000;
-
-                esp_err_t res = mqtt_publish_button(player_id, btn, ts);
-                if (res != ESP_OK)
-                {
-                    lcd_show_message("Send Failed", "Error");
-                }
+                draw_animation();
             }
-            else
+            break;
+
+        case MAIN_EVENT_REACTION_ARMED:
+            if (!esp_timer_is_active(s_reaction_timer))
+            {
+                esp_timer_start_periodic(s_reaction_timer, (uint64_t)REACTION_POLL_MS * 1000);
+            }
+            break;
+
+        case MAIN_EVENT_REACTION_TICK:
+            if (!reaction_poll())
             {
-                lcd_show_message("Offline", "Not Sent");
+                esp_timer_stop(s_reaction_timer);
             }
+            break;
         }
     }
 }
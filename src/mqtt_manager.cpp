@@ -1,28 +1,566 @@
 #include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "freertos/semphr.h"
+#include "static_alloc.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
 #include "mqtt_client.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "command_table.h"
+#include "json_arena.h"
+#include "trace.h"
+#include "heap_guard.h"
 #include <string.h>
 #include <stdio.h>
 
 static const char *TAG = "mqtt_manager";
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 static bool is_connected = false;
-static mqtt_message_callback_t s_message_callback = NULL;
+static uint8_t s_binary_topics = WIRE_TOPIC_NONE; // wire_topic_t bits negotiated with the server
+static bool s_button_acks = false;                 // Server acks button events
+static volatile bool s_caps_pending = false;       // Capability reply not yet received
+static int64_t s_caps_sent_us = 0;                 // When this connection's caps offer was queued
+static int64_t s_dispatch_rx_us = 0;               // Arrival time of the message being handled
+static char s_base_id[MQTT_BASE_ID_MAX_LEN] = "";
+static char s_client_id[24] = "";
+static char s_will_topic[MQTT_FILTER_MAX_LEN];
+
+// Reconnect timing
+static mqtt_reconnect_stats_t s_reconnect_stats = {};
+static int64_t s_disconnect_us = 0;     // 0 until the first disconnect
+static bool s_await_first_message = false;
+static bool s_subscribed = false; // Subscribed at least once since boot
+static bool s_started = false;
+static mqtt_connection_cb_t s_connection_cbs[MQTT_MAX_CONNECTION_CALLBACKS];
+static int s_connection_cb_count = 0;
+
+static void notify_connection(bool connected)
+{
+    for (int i = 0; i < s_connection_cb_count; i++)
+    {
+        s_connection_cbs[i](connected);
+    }
+}
+
+#if CONFIG_MQTT_PROTOCOL_5
+// Publish properties apply to the next publish, so setting them and
+// publishing must not interleave between tasks
+static SemaphoreHandle_t s_publish_lock = NULL;
+STATIC_MUTEX_BUFFERS(s_publish_lock);
+static bool s_aliases_enabled = true;
+static uint32_t s_aliases_sent = 0; // Bit per alias the broker has seen this connection
+static uint32_t s_aliases_connection = 0;        // Connection the two above belong to
+static volatile uint32_t s_connection_count = 0; // Bumped on every CONNECTED
+#endif
+
+typedef struct
+{
+    const char *key;
+    const char *value;
+} mqtt_user_property_t;
+
+#define MQTT_MAX_USER_PROPERTIES 4
+
+// Topic router
+// Exact filters are keyed by the whole topic, wildcard filters by their first
+// level ("game" for "game/+/display"), so dispatch costs two hash probes no
+// matter how many routes exist. Filters with a wildcard in the first level
+// cannot be keyed and are checked on every message.
+typedef struct
+{
+    char filter[MQTT_FILTER_MAX_LEN]; // Namespaced
+    int filter_len;
+    int key_len;
+    uint32_t key_hash;
+    bool wildcard;
+    int qos;
+    mqtt_topic_handler_t handler;
+    void *ctx;
+    uint32_t budget_us;
+    int8_t next; // Next route with the same key, -1 at end of chain
+    mqtt_route_stats_t stats;
+} mqtt_route_t;
+
+static mqtt_route_t s_routes[MQTT_MAX_ROUTES];
+static int s_route_count = 0;
+static int8_t s_route_slots[MQTT_ROUTE_SLOTS];
+static int8_t s_unkeyed_routes[MQTT_MAX_ROUTES];
+static int s_unkeyed_count = 0;
+
+// Worker pipeline
+// Each ring item is a header followed by the topic and the payload. Fragments
+// are copied straight into an acquired item, which is only committed to the
+// worker once the whole message has arrived.
+typedef struct
+{
+    uint32_t enqueue_us;
+    int payload_len;
+    uint16_t topic_len;
+    bool complete; // false if the connection dropped mid-message
+} mqtt_rx_item_t;
+
+static RingbufHandle_t s_rx_ring = NULL;
+STATIC_RINGBUF_BUFFERS(s_rx_ring, MQTT_RX_RING_SIZE);
+STATIC_TASK_BUFFERS(s_worker, MQTT_WORKER_STACK_SIZE);
+static mqtt_rx_item_t *s_rx_item = NULL; // Item being filled, NULL when idle
+static int s_rx_received = 0;
+static mqtt_worker_stats_t s_worker_stats = {};
+
+static bool base_id_valid(const char *id)
+{
+    size_t len = strlen(id);
+    return len > 0 && len < MQTT_BASE_ID_MAX_LEN && strpbrk(id, "/+#") == NULL &&
+           strcmp(id, MQTT_BROADCAST_ID) != 0;
+}
 
 /**
- * Subscribe to game topics
+ * Load the base ID on first use
+ */
+static void resolve_base_id(void)
+{
+    if (s_base_id[0] != '\0')
+        return;
+
+    nvs_handle_t nvs;
+    if (nvs_open("config", NVS_READONLY, &nvs) == ESP_OK)
+    {
+        size_t len = sizeof(s_base_id);
+        if (nvs_get_str(nvs, "base_id", s_base_id, &len) != ESP_OK || !base_id_valid(s_base_id))
+            s_base_id[0] = '\0';
+        nvs_close(nvs);
+    }
+
+    if (s_base_id[0] == '\0')
+    {
+        uint8_t mac[6] = {};
+        esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        snprintf(s_base_id, sizeof(s_base_id), "%02x%02x%02x", mac[3], mac[4], mac[5]);
+    }
+}
+
+/**
+ * Insert an ID after the first level: "game/display" -> "game/<id>/display"
+ * @return Length written, 0 if it does not fit
+ */
+static int namespace_topic(const char *topic, const char *id, char *out, size_t cap)
+{
+#if MQTT_NAMESPACE_TOPICS
+    const char *rest = strchr(topic, '/');
+    int level_len = rest != NULL ? (int)(rest - topic) : (int)strlen(topic);
+    int len = snprintf(out, cap, "%.*s/%s%s", level_len, topic, id, rest != NULL ? rest : "");
+#else
+    int len = snprintf(out, cap, "%s", topic);
+#endif
+    return len < (int)cap ? len : 0;
+}
+
+/**
+ * Subscribe to every registered topic filter
  */
 static void subscribe_to_topics(void)
 {
-    if (mqtt_client == NULL)
+    if (mqtt_client == NULL || s_route_count == 0)
+        return;
+
+    // One SUBSCRIBE packet for every route
+    esp_mqtt_topic_t topics[MQTT_MAX_ROUTES + 1];
+    int count = 0;
+    for (int i = 0; i < s_route_count; i++)
+    {
+        topics[count].filter = s_routes[i].filter;
+        topics[count].qos = s_routes[i].qos;
+        count++;
+    }
+#if MQTT_NAMESPACE_TOPICS
+    // Broadcasts are mapped onto our own topics in dispatch_message()
+    topics[count].filter = "game/" MQTT_BROADCAST_ID "/#";
+    topics[count].qos = 1;
+    count++;
+#endif
+    esp_mqtt_client_subscribe_multiple(mqtt_client, topics, count);
+    ESP_LOGI(TAG, "Subscribed to %d topics", count);
+}
+
+/**
+ * Match a topic against a filter with MQTT '+' and '#' wildcards
+ */
+static bool topic_matches_filter(const char *filter, int filter_len, const char *topic, int topic_len)
+{
+    int f = 0;
+    int t = 0;
+
+    while (f < filter_len)
+    {
+        if (filter[f] == '#')
+            return true;
+
+        if (filter[f] == '+')
+        {
+            while (t < topic_len && topic[t] != '/')
+                t++;
+            f++;
+            continue;
+        }
+
+        if (t == topic_len)
+        {
+            // "a/#" also matches the parent level "a"
+            return filter[f] == '/' && f + 2 == filter_len && filter[f + 1] == '#';
+        }
+
+        if (filter[f] != topic[t])
+            return false;
+        f++;
+        t++;
+    }
+
+    return t == topic_len;
+}
+
+/**
+ * Find the slot holding the route chain for a key, or the empty slot it belongs in
+ */
+static int find_route_slot(const char *key, int key_len, uint32_t key_hash)
+{
+    for (int probe = 0; probe < MQTT_ROUTE_SLOTS; probe++)
+    {
+        int slot = (key_hash + probe) & (MQTT_ROUTE_SLOTS - 1);
+        int8_t head = s_route_slots[slot];
+        if (head < 0)
+            return slot;
+
+        const mqtt_route_t *route = &s_routes[head];
+        if (route->key_hash == key_hash && route->key_len == key_len &&
+            memcmp(route->filter, key, key_len) == 0)
+            return slot;
+    }
+    return -1;
+}
+
+/**
+ * Run a route's handler and account its processing time
+ */
+static void run_route(mqtt_route_t *route, const char *topic, int topic_len, const char *payload, int payload_len)
+{
+    int route_index = route - s_routes;
+    TRACE(TRACE_MQTT_HANDLER_BEGIN, route_index, payload_len);
+    int64_t start = esp_timer_get_time();
+    // Handlers parse with cJSON; the whole tree is dropped in one step afterwards
+    json_arena_begin();
+    route->handler(topic, topic_len, payload, payload_len, route->ctx);
+    json_arena_end();
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+    TRACE(TRACE_MQTT_HANDLER_END, route_index, elapsed_us);
+
+    route->stats.messages++;
+    route->stats.total_us += elapsed_us;
+    if (elapsed_us > route->stats.max_us)
+        route->stats.max_us = elapsed_us;
+
+    if (route->budget_us > 0 && elapsed_us > route->budget_us)
+    {
+        route->stats.over_budget++;
+        ESP_LOGW(TAG, "Handler for %s took %lu us (budget %lu us)",
+                 route->filter, (unsigned long)elapsed_us, (unsigned long)route->budget_us);
+    }
+}
+
+/**
+ * Call every route in a chain whose filter matches the topic
+ */
+static void dispatch_chain(int8_t idx, const char *topic, int topic_len, const char *payload, int payload_len, bool wildcard)
+{
+    for (; idx >= 0; idx = s_routes[idx].next)
+    {
+        mqtt_route_t *route = &s_routes[idx];
+        if (route->wildcard != wildcard)
+            continue;
+        if (wildcard ? !topic_matches_filter(route->filter, route->filter_len, topic, topic_len)
+                     : (route->filter_len != topic_len || memcmp(route->filter, topic, topic_len) != 0))
+            continue;
+        run_route(route, topic, topic_len, payload, payload_len);
+    }
+}
+
+/**
+ * Hand a complete message to every matching route
+ */
+static void dispatch_message(const char *topic, int topic_len, const char *payload, int payload_len)
+{
+    if (topic_len <= 0 || payload_len <= 0 || s_route_count == 0)
+        return;
+
+#if MQTT_NAMESPACE_TOPICS
+    // "game/all/display" is handled as "game/<id>/display"
+    static const char BROADCAST_PREFIX[] = "game/" MQTT_BROADCAST_ID "/";
+    const int prefix_len = sizeof(BROADCAST_PREFIX) - 1;
+    char local_topic[MQTT_TOPIC_MAX_LEN + MQTT_BASE_ID_MAX_LEN];
+    if (topic_len > prefix_len && memcmp(topic, BROADCAST_PREFIX, prefix_len) == 0)
+    {
+        int len = snprintf(local_topic, sizeof(local_topic), "game/%s/%.*s", s_base_id,
+                           topic_len - prefix_len, topic + prefix_len);
+        if (len >= (int)sizeof(local_topic))
+            return;
+        topic = local_topic;
+        topic_len = len;
+    }
+#endif
+
+    int slot = find_route_slot(topic, topic_len, str_hash(topic, topic_len));
+    if (slot >= 0)
+        dispatch_chain(s_route_slots[slot], topic, topic_len, payload, payload_len, false);
+
+    int level_len = 0;
+    while (level_len < topic_len && topic[level_len] != '/')
+        level_len++;
+    slot = find_route_slot(topic, level_len, str_hash(topic, level_len));
+    if (slot >= 0)
+        dispatch_chain(s_route_slots[slot], topic, topic_len, payload, payload_len, true);
+
+    for (int i = 0; i < s_unkeyed_count; i++)
+    {
+        mqtt_route_t *route = &s_routes[s_unkeyed_routes[i]];
+        if (topic_matches_filter(route->filter, route->filter_len, topic, topic_len))
+            run_route(route, topic, topic_len, payload, payload_len);
+    }
+}
+
+/**
+ * Hand the item being filled to the worker
+ */
+static void commit_rx_item(bool complete)
+{
+    s_rx_item->complete = complete;
+    xRingbufferSendComplete(s_rx_ring, s_rx_item);
+    s_rx_item = NULL;
+
+    s_worker_stats.queued++;
+    uint32_t pending = s_worker_stats.queued - s_worker_stats.processed;
+    if (pending > s_worker_stats.pending_high_water)
+        s_worker_stats.pending_high_water = pending;
+}
+
+/**
+ * Handle MQTT_EVENT_DATA
+ * Copies the message into the worker ring. Messages larger than the client's
+ * receive buffer arrive in several events and are reassembled in place.
+ */
+static void handle_data_event(esp_mqtt_event_handle_t event)
+{
+    // Only the first fragment carries the topic
+    if (event->current_data_offset == 0)
+    {
+        if (s_rx_item != NULL)
+        {
+            commit_rx_item(false);
+        }
+
+        TRACE(TRACE_MQTT_RX, event->topic_len, event->total_data_len);
+        if (event->topic_len <= 0 || event->total_data_len <= 0)
+            return;
+
+        if (event->topic_len > MQTT_TOPIC_MAX_LEN || event->total_data_len > MQTT_RX_BUFFER_SIZE)
+        {
+            s_worker_stats.dropped++;
+            ESP_LOGW(TAG, "Dropping oversized message (topic %d B, payload %d B)",
+                     event->topic_len, event->total_data_len);
+            return;
+        }
+
+        void *item = NULL;
+        size_t item_size = sizeof(mqtt_rx_item_t) + event->topic_len + event->total_data_len;
+        if (xRingbufferSendAcquire(s_rx_ring, &item, item_size, 0) != pdTRUE)
+        {
+            s_worker_stats.dropped++;
+            ESP_LOGW(TAG, "Worker queue full, dropping message on %.*s", event->topic_len, event->topic);
+            return;
+        }
+
+        size_t free_bytes = xRingbufferGetCurFreeSize(s_rx_ring);
+        if (free_bytes < s_worker_stats.free_bytes_low_water)
+            s_worker_stats.free_bytes_low_water = free_bytes;
+
+        s_rx_item = (mqtt_rx_item_t *)item;
+        s_rx_item->enqueue_us = (uint32_t)esp_timer_get_time();
+        s_rx_item->payload_len = event->total_data_len;
+        s_rx_item->topic_len = event->topic_len;
+        memcpy(s_rx_item + 1, event->topic, event->topic_len);
+        s_rx_received = 0;
+    }
+
+    if (s_rx_item == NULL || event->total_data_len != s_rx_item->payload_len ||
+        event->current_data_offset != s_rx_received ||
+        event->current_data_offset + event->data_len > s_rx_item->payload_len)
         return;
 
-    esp_mqtt_client_subscribe(mqtt_client, MQTT_TOPIC_STATUS, 1);
-    esp_mqtt_client_subscribe(mqtt_client, MQTT_TOPIC_DISPLAY, 1);
-    esp_mqtt_client_subscribe(mqtt_client, MQTT_TOPIC_SOUND, 1);
+    char *payload = (char *)(s_rx_item + 1) + s_rx_item->topic_len;
+    memcpy(payload + event->current_data_offset, event->data, event->data_len);
+    s_rx_received += event->data_len;
 
-    ESP_LOGI(TAG, "Subscribed to game topics: %s, %s, %s",
-             MQTT_TOPIC_STATUS, MQTT_TOPIC_DISPLAY, MQTT_TOPIC_SOUND);
+    if (s_rx_received == s_rx_item->payload_len)
+    {
+        commit_rx_item(true);
+    }
+}
+
+static int publish(const char *topic, uint16_t alias, const char *payload, int len, int qos, int retain,
+                   uint32_t expiry_s, const mqtt_user_property_t *props, int prop_count);
+
+/**
+ * Send the messages every new connection starts with
+ * Runs on the worker: publish() takes s_publish_lock and then the client's
+ * API lock, which the event handler already holds, so publishing from the
+ * handler could deadlock against another task's publish.
+ */
+static void publish_connect_messages(void)
+{
+    // Still needed on a resumed session: the broker sent our will when the link dropped
+    publish(MQTT_TOPIC_CONNECTION, 0, "CONNECTED", 0, 1, 1, 0, NULL, 0);
+    publish(MQTT_TOPIC_CAPS, 0, "{\"wire\":[2],\"binary\":[\"button\",\"ack\",\"display\"],\"acks\":true}",
+            0, 1, 0, 0, NULL, 0);
+}
+
+/**
+ * Queue a connect marker (an item with no topic) behind any messages
+ * already in the ring, so the worker sends the connect messages in order
+ */
+static void queue_connect_messages(void)
+{
+    mqtt_rx_item_t marker = {};
+    marker.enqueue_us = (uint32_t)esp_timer_get_time();
+    marker.complete = true;
+    if (xRingbufferSend(s_rx_ring, &marker, sizeof(marker), pdMS_TO_TICKS(MQTT_CONNECT_QUEUE_WAIT_MS)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Worker queue full, CONNECTED and caps not sent");
+        return;
+    }
+    s_worker_stats.queued++;
+}
+
+/**
+ * Worker task: runs message handlers outside the esp-mqtt client task
+ */
+static void mqtt_worker_task(void *pvParameters)
+{
+    while (1)
+    {
+        size_t size = 0;
+        mqtt_rx_item_t *item = (mqtt_rx_item_t *)xRingbufferReceive(s_rx_ring, &size, portMAX_DELAY);
+        if (item == NULL)
+            continue;
+
+        int64_t now = esp_timer_get_time();
+        uint32_t wait_us = (uint32_t)now - item->enqueue_us;
+        if (wait_us > s_worker_stats.max_queue_wait_us)
+            s_worker_stats.max_queue_wait_us = wait_us;
+        s_dispatch_rx_us = now - wait_us;
+
+        if (item->topic_len == 0)
+        {
+            publish_connect_messages();
+        }
+        else if (item->complete)
+        {
+            const char *topic = (const char *)(item + 1);
+            dispatch_message(topic, item->topic_len, topic + item->topic_len, item->payload_len);
+        }
+
+        vRingbufferReturnItem(s_rx_ring, item);
+        s_worker_stats.processed++;
+    }
+}
+
+/**
+ * Publish with optional MQTT 5 properties
+ * On 3.1.1 the alias, expiry and user properties are ignored.
+ * @param alias MQTT_ALIAS_* or 0
+ * @param expiry_s Message expiry in seconds, 0 for none
+ * @return Message ID, -1 on failure
+ */
+static int publish(const char *topic, uint16_t alias, const char *payload, int len, int qos, int retain,
+                   uint32_t expiry_s, const mqtt_user_property_t *props, int prop_count)
+{
+    char full_topic[MQTT_FILTER_MAX_LEN];
+    if (namespace_topic(topic, s_base_id, full_topic, sizeof(full_topic)) == 0)
+    {
+        ESP_LOGE(TAG, "Topic too long: %s", topic);
+        return -1;
+    }
+    topic = full_topic;
+
+    // esp-mqtt copies every QoS 1 message into a heap outbox entry, and v5
+    // properties are heap lists; that is by design, not a firmware leak
+    heap_guard_pause();
+#if CONFIG_MQTT_PROTOCOL_5
+    xSemaphoreTake(s_publish_lock, portMAX_DELAY);
+
+    // The event handler cannot take s_publish_lock: it runs under the
+    // client's API lock, which a publish holding s_publish_lock may be
+    // waiting for. It only counts connections, and the reset happens here.
+    if (s_aliases_connection != s_connection_count)
+    {
+        s_aliases_connection = s_connection_count;
+        s_aliases_sent = 0;
+        s_aliases_enabled = true;
+    }
+
+    esp_mqtt5_publish_property_config_t property = {};
+    property.message_expiry_interval = expiry_s;
+
+    if (prop_count > 0)
+    {
+        esp_mqtt5_user_property_item_t items[MQTT_MAX_USER_PROPERTIES];
+        if (prop_count > MQTT_MAX_USER_PROPERTIES)
+            prop_count = MQTT_MAX_USER_PROPERTIES;
+        for (int i = 0; i < prop_count; i++)
+        {
+            items[i].key = props[i].key;
+            items[i].value = props[i].value;
+        }
+        esp_mqtt5_client_set_user_property(&property.user_property, items, prop_count);
+    }
+
+    const char *wire_topic = topic;
+    if (alias != 0 && s_aliases_enabled)
+    {
+        property.topic_alias = alias;
+        // Once the broker has the mapping the topic can be left out. QoS > 0
+        // messages may be resent on a new connection where the alias is not
+        // known yet, so they always carry the topic.
+        if (qos == 0 && (s_aliases_sent & (1u << alias)))
+            wire_topic = "";
+    }
+
+    if (esp_mqtt5_client_set_publish_property(mqtt_client, &property) != ESP_OK && property.topic_alias != 0)
+    {
+        // The broker allows fewer aliases than we use
+        ESP_LOGW(TAG, "Topic alias %u refused, disabling aliases", alias);
+        s_aliases_enabled = false;
+        property.topic_alias = 0;
+        wire_topic = topic;
+        esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+    }
+
+    int msg_id = esp_mqtt_client_publish(mqtt_client, wire_topic, payload, len, qos, retain);
+    if (msg_id >= 0 && property.topic_alias != 0)
+    {
+        s_aliases_sent |= 1u << alias;
+    }
+
+    if (property.user_property != NULL)
+    {
+        esp_mqtt5_client_delete_user_property(property.user_property);
+    }
+    xSemaphoreGive(s_publish_lock);
+#else
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, payload, len, qos, retain);
+#endif
+    heap_guard_resume();
+    return msg_id;
 }
 
 /**
@@ -36,44 +574,79 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     switch ((esp_mqtt_event_id_t)event_id)
     {
     case MQTT_EVENT_CONNECTED:
-        ESP_LOGI(TAG, "MQTT connected to broker");
+        ESP_LOGI(TAG, "MQTT connected to broker (session %s)", event->session_present ? "resumed" : "new");
         is_connected = true;
-        esp_mqtt_client_publish(mqtt_client, "game/connection", "CONNECTED", 0, 1, 1);
-        subscribe_to_topics();
+        if (s_disconnect_us != 0)
+        {
+            s_reconnect_stats.reconnects++;
+            s_reconnect_stats.last_connect_us = (uint32_t)(esp_timer_get_time() - s_disconnect_us);
+            s_await_first_message = true;
+        }
+#if CONFIG_MQTT_PROTOCOL_5
+        // Aliases are per connection; publish() resets them under its lock
+        s_connection_count++;
+#endif
+        if (event->session_present)
+        {
+            s_reconnect_stats.sessions_resumed++;
+        }
+        // A resumed session keeps our subscriptions, but after a reboot they
+        // may belong to older firmware, so always subscribe once per boot
+        if (!event->session_present || !s_subscribed)
+        {
+            subscribe_to_topics();
+            s_subscribed = true;
+        }
+
+        // Fall back to JSON until the server answers the capability offer
+        s_binary_topics = WIRE_TOPIC_NONE;
+        s_button_acks = false;
+        s_caps_sent_us = esp_timer_get_time();
+        s_caps_pending = true;
+        queue_connect_messages();
+        notify_connection(true);
         break;
 
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGW(TAG, "MQTT disconnected from broker");
+        if (is_connected || s_disconnect_us == 0)
+        {
+            // Time from the first failure, not from each failed attempt
+            s_disconnect_us = esp_timer_get_time();
+        }
+        if (is_connected)
+        {
+            notify_connection(false);
+        }
         is_connected = false;
+        s_await_first_message = false;
+        if (s_rx_item != NULL)
+        {
+            // Release the partial message so the ring does not stall
+            commit_rx_item(false);
+        }
         break;
 
     case MQTT_EVENT_SUBSCRIBED:
         ESP_LOGI(TAG, "Subscribed, msg_id=%d", event->msg_id);
         break;
 
-        if (event->topic_len > 0 && event->data_len > 0)
+    case MQTT_EVENT_DATA:
+        if (s_await_first_message)
         {
-            char topic[64] = {0};
-            char payload[256] = {0};
-
-            int topic_len = event->topic_len < 63 ? event->topic_len : 63;
-            int data_len = event->data_len < 255 ? event->data_len : 255;
-
-            strncpy(topic, event->topic, topic_len);
-            strncpy(payload, event->data, data_len);
-
-            ESP_LOGI(TAG, "Received: topic=%s, payload=%s", topic, payload);
-
-            if (s_message_callback != NULL)
-            {
-                int actual_len = strlen(payload);
-                s_message_callback(topic, payload, actual_len);
-            }
+            s_await_first_message = false;
+            uint32_t elapsed = (uint32_t)(esp_timer_get_time() - s_disconnect_us);
+            s_reconnect_stats.last_first_message_us = elapsed;
+            if (elapsed > s_reconnect_stats.max_first_message_us)
+                s_reconnect_stats.max_first_message_us = elapsed;
+            ESP_LOGI(TAG, "First message %lu ms after disconnect (connected after %lu ms)",
+                     (unsigned long)(elapsed / 1000), (unsigned long)(s_reconnect_stats.last_connect_us / 1000));
         }
+        handle_data_event(event);
         break;
 
     case MQTT_EVENT_PUBLISHED:
-        ESP_LOGI(TAG, "Message published, msg_id=%d", event->msg_id);
+        TRACE(TRACE_MQTT_PUBLISHED, event->msg_id, 0);
         break;
 
     case MQTT_EVENT_ERROR:
@@ -86,7 +659,43 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
 }
 
 /**
- * Initialize MQTT client and start connection
+ * Handle the server's answer to the capability offer
+ */
+static void on_caps_message(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx)
+{
+    cJSON *root = cJSON_ParseWithLength(payload, payload_len);
+    if (root == NULL)
+    {
+        ESP_LOGW(TAG, "Invalid capability reply");
+        return;
+    }
+
+    uint8_t binary = WIRE_TOPIC_NONE;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "binary"))
+    {
+        const char *name = cJSON_GetStringValue(item);
+        if (name == NULL)
+            continue;
+        if (strcmp(name, "button") == 0)
+            binary |= WIRE_TOPIC_BUTTON;
+        else if (strcmp(name, "ack") == 0)
+            binary |= WIRE_TOPIC_ACK;
+        else if (strcmp(name, "display") == 0)
+            binary |= WIRE_TOPIC_DISPLAY;
+    }
+    bool acks = cJSON_IsTrue(cJSON_GetObjectItem(root, "acks"));
+    cJSON_Delete(root);
+
+    s_binary_topics = binary;
+    s_button_acks = acks;
+    s_caps_pending = false;
+    ESP_LOGI(TAG, "Wire format negotiated: binary topics 0x%02X, button acks %s",
+             s_binary_topics, s_button_acks ? "on" : "off");
+}
+
+/**
+ * Initialize MQTT client without connecting
  * @return ESP_OK on success
  */
 esp_err_t mqtt_manager_init(void)
@@ -96,11 +705,48 @@ esp_err_t mqtt_manager_init(void)
     mqtt_cfg.broker.address.uri = MQTT_BROKER_URL;
 
     // LWT Configuration
-    mqtt_cfg.session.last_will.topic = "game/connection";
     mqtt_cfg.session.last_will.msg = "DISCONNECTED";
     mqtt_cfg.session.last_will.qos = 1;
     mqtt_cfg.session.last_will.retain = 0;
 
+    json_arena_init();
+    resolve_base_id();
+    snprintf(s_client_id, sizeof(s_client_id), MQTT_CLIENT_ID_PREFIX "%s", s_base_id);
+    mqtt_cfg.credentials.client_id = s_client_id;
+    namespace_topic(MQTT_TOPIC_CONNECTION, s_base_id, s_will_topic, sizeof(s_will_topic));
+    mqtt_cfg.session.last_will.topic = s_will_topic;
+    ESP_LOGI(TAG, "Base ID: %s", s_base_id);
+#if MQTT_PERSISTENT_SESSION
+    mqtt_cfg.session.disable_clean_session = true;
+#endif
+    mqtt_cfg.network.reconnect_timeout_ms = MQTT_RECONNECT_TIMEOUT_MS;
+
+#if CONFIG_MQTT_PROTOCOL_5
+    mqtt_cfg.session.protocol_ver = MQTT_PROTOCOL_V_5;
+    s_publish_lock = STATIC_MUTEX_CREATE(s_publish_lock);
+    if (s_publish_lock == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create publish lock");
+        return ESP_FAIL;
+    }
+#endif
+
+    s_rx_ring = STATIC_RINGBUF_CREATE(s_rx_ring, MQTT_RX_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (s_rx_ring == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create worker ring buffer");
+        return ESP_FAIL;
+    }
+    s_worker_stats.free_bytes_low_water = xRingbufferGetCurFreeSize(s_rx_ring);
+
+    if (STATIC_TASK_CREATE(s_worker, mqtt_worker_task, "mqtt_worker", MQTT_WORKER_STACK_SIZE, NULL, MQTT_WORKER_PRIORITY) == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create worker task");
+        return ESP_FAIL;
+    }
+
+    mqtt_register_handler(MQTT_TOPIC_CAPS_REPLY, 1, on_caps_message, NULL, 20);
+
     mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     if (mqtt_client == NULL)
     {
@@ -108,25 +754,228 @@ esp_err_t mqtt_manager_init(void)
         return ESP_FAIL;
     }
 
+#if CONFIG_MQTT_PROTOCOL_5
+    esp_mqtt5_connection_property_config_t connect_property = {};
+    connect_property.topic_alias_maximum = MQTT_V5_TOPIC_ALIAS_MAX;
+    connect_property.request_problem_info = true;
+#if MQTT_PERSISTENT_SESSION
+    connect_property.session_expiry_interval = MQTT_SESSION_EXPIRY_S;
+#endif
+    esp_mqtt5_client_set_connect_property(mqtt_client, &connect_property);
+#endif
+
     esp_mqtt_client_register_event(mqtt_client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_mqtt_client_start(mqtt_client);
 
-    ESP_LOGI(TAG, "MQTT client initialized and started");
+    ESP_LOGI(TAG, "MQTT client initialized");
     return ESP_OK;
 }
 
 /**
- * Set callback for incoming MQTT messages
+ * Start connecting to the broker
+ * Deferred until the network is up so the first attempt does not fail and
+ * sit out a reconnect timeout.
+ */
+esp_err_t mqtt_manager_start(void)
+{
+    if (mqtt_client == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_started)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t err = esp_mqtt_client_start(mqtt_client);
+    if (err == ESP_OK)
+    {
+        s_started = true;
+        ESP_LOGI(TAG, "MQTT client started");
+    }
+    return err;
+}
+
+esp_err_t mqtt_add_connection_callback(mqtt_connection_cb_t cb)
+{
+    if (cb == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_connection_cb_count >= MQTT_MAX_CONNECTION_CALLBACKS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    s_connection_cbs[s_connection_cb_count++] = cb;
+    return ESP_OK;
+}
+
+/**
+ * Route a topic filter to a handler and subscribe to it
+ */
+esp_err_t mqtt_register_handler(const char *topic_filter, int qos, mqtt_topic_handler_t handler, void *ctx, uint32_t budget_ms)
+{
+    if (topic_filter == NULL || handler == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_route_count == 0)
+    {
+        memset(s_route_slots, -1, sizeof(s_route_slots));
+    }
+
+    if (s_route_count >= MQTT_MAX_ROUTES)
+    {
+        ESP_LOGE(TAG, "Route table full, cannot register %s", topic_filter);
+        return ESP_ERR_NO_MEM;
+    }
+
+    resolve_base_id();
+
+    mqtt_route_t *route = &s_routes[s_route_count];
+    route->filter_len = namespace_topic(topic_filter, s_base_id, route->filter, sizeof(route->filter));
+    if (route->filter_len == 0)
+    {
+        ESP_LOGE(TAG, "Topic filter too long: %s", topic_filter);
+        return ESP_ERR_INVALID_ARG;
+    }
+    topic_filter = route->filter;
+    route->wildcard = strpbrk(topic_filter, "+#") != NULL;
+    route->qos = qos;
+    route->handler = handler;
+    route->ctx = ctx;
+    route->budget_us = budget_ms * 1000;
+    route->next = -1;
+    memset(&route->stats, 0, sizeof(route->stats));
+
+    // Wildcard routes are keyed by their first level
+    route->key_len = route->filter_len;
+    if (route->wildcard)
+    {
+        route->key_len = strcspn(topic_filter, "/");
+    }
+    route->key_hash = str_hash(topic_filter, route->key_len);
+
+    if (route->wildcard && strpbrk(topic_filter, "+#") < topic_filter + route->key_len)
+    {
+        s_unkeyed_routes[s_unkeyed_count++] = s_route_count;
+    }
+    else
+    {
+        int slot = find_route_slot(topic_filter, route->key_len, route->key_hash);
+        if (slot < 0)
+        {
+            ESP_LOGE(TAG, "Route slots full, cannot register %s", topic_filter);
+            return ESP_ERR_NO_MEM;
+        }
+        route->next = s_route_slots[slot];
+        s_route_slots[slot] = s_route_count;
+    }
+    s_route_count++;
+
+    if (is_connected)
+    {
+        esp_mqtt_client_subscribe(mqtt_client, topic_filter, qos);
+    }
+
+    ESP_LOGI(TAG, "Registered route: %s", topic_filter);
+    return ESP_OK;
+}
+
+/**
+ * Get the number of registered routes
+ */
+int mqtt_get_route_count(void)
+{
+    return s_route_count;
+}
+
+/**
+ * Get processing statistics for a route
+ */
+esp_err_t mqtt_get_route_stats(int index, const char **filter_out, mqtt_route_stats_t *stats_out)
+{
+    if (index < 0 || index >= s_route_count || stats_out == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (filter_out != NULL)
+    {
+        *filter_out = s_routes[index].filter;
+    }
+    *stats_out = s_routes[index].stats;
+    return ESP_OK;
+}
+
+/**
+ * Get worker queue statistics
+ */
+void mqtt_get_worker_stats(mqtt_worker_stats_t *stats_out)
+{
+    if (stats_out != NULL)
+    {
+        *stats_out = s_worker_stats;
+    }
+}
+
+/**
+ * Get reconnect timing
+ */
+void mqtt_get_reconnect_stats(mqtt_reconnect_stats_t *stats_out)
+{
+    if (stats_out != NULL)
+    {
+        *stats_out = s_reconnect_stats;
+    }
+}
+
+/**
+ * Get the MQTT client ID
+ */
+const char *mqtt_get_client_id(void)
+{
+    return s_client_id;
+}
+
+/**
+ * Get the base ID used in topics
  */
-void mqtt_set_message_callback(mqtt_message_callback_t callback)
+const char *mqtt_get_base_id(void)
 {
-    s_message_callback = callback;
+    resolve_base_id();
+    return s_base_id;
+}
+
+/**
+ * Store a base ID in NVS for the next boot
+ */
+esp_err_t mqtt_set_base_id(const char *base_id)
+{
+    if (base_id == NULL || !base_id_valid(base_id))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open("config", NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nvs_set_str(nvs, "base_id", base_id);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
 }
 
 /**
  * Publish a button press event
  */
-esp_err_t mqtt_publish_button(const char *player_id, uint8_t button, int64_t timestamp_ms)
+esp_err_t mqtt_publish_button(const char *player_id, uint8_t button, uint32_t session, uint32_t seq, int64_t timestamp_ms, int32_t error_ms)
 {
     if (!is_connected)
     {
@@ -139,17 +988,33 @@ esp_err_t mqtt_publish_button(const char *player_id, uint8_t button, int64_t tim
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Format JSON payload
     char payload[128];
-    // Payload: {"player":"<id>","button":<id>,"timestamp":<ts>}
-    snprintf(payload, sizeof(payload),
-             "{\"player\":\"%s\",\"button\":%d,\"timestamp\":%lld}",
-             player_id, button, timestamp_ms);
+    int len = 0;
+    if (s_binary_topics & WIRE_TOPIC_BUTTON)
+    {
+        len = wire_encode_button((uint8_t *)payload, sizeof(payload), button, session, seq, timestamp_ms, error_ms);
+    }
+    else
+    {
+        // Payload: {"player":"<id>","button":<id>,"session":<id>,"seq":<n>,"timestamp":<ts>,"err":<ms>}
+        len = snprintf(payload, sizeof(payload),
+                       "{\"player\":\"%s\",\"button\":%d,\"session\":%lu,\"seq\":%lu,\"timestamp\":%lld,\"err\":%ld}",
+                       player_id, button, (unsigned long)session, (unsigned long)seq, timestamp_ms, (long)error_ms);
+    }
 
-    int msg_id = esp_mqtt_client_publish(mqtt_client, MQTT_TOPIC_BUTTON, payload, 0, 0, 0);
+#if CONFIG_MQTT_PROTOCOL_5 && MQTT_V5_USER_PROPERTIES
+    char session_str[12];
+    char seq_str[12];
+    snprintf(session_str, sizeof(session_str), "%lu", (unsigned long)session);
+    snprintf(seq_str, sizeof(seq_str), "%lu", (unsigned long)seq);
+    const mqtt_user_property_t props[] = {{"session", session_str}, {"seq", seq_str}};
+    int msg_id = publish(MQTT_TOPIC_BUTTON, MQTT_ALIAS_BUTTON, payload, len, 0, 0, 0, props, 2);
+#else
+    int msg_id = publish(MQTT_TOPIC_BUTTON, MQTT_ALIAS_BUTTON, payload, len, 0, 0, 0, NULL, 0);
+#endif
     if (msg_id >= 0)
     {
-        ESP_LOGI(TAG, "Published button event: %s", payload);
+        TRACE(TRACE_BUTTON_TX, button, seq);
         return ESP_OK;
     }
     else
@@ -159,6 +1024,90 @@ esp_err_t mqtt_publish_button(const char *player_id, uint8_t button, int64_t tim
     }
 }
 
+/**
+ * Publish a clock sync ping
+ */
+esp_err_t mqtt_publish_time_ping(int64_t t0_us)
+{
+    if (!is_connected)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char payload[40];
+    int len = snprintf(payload, sizeof(payload), "{\"t0\":%lld}", t0_us);
+    // A ping that sat in a queue would only produce a useless sample
+    return publish(MQTT_TOPIC_TIME_PING, 0, payload, len, 0, 0, MQTT_PING_EXPIRY_S, NULL, 0) >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Publish a cue report
+ */
+esp_err_t mqtt_publish_cue_report(const char *payload, int len)
+{
+    if (!is_connected)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return publish(MQTT_TOPIC_CUE_REPORT, 0, payload, len, 1, 0, 0, NULL, 0) >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Publish a reaction round result
+ */
+esp_err_t mqtt_publish_reaction_result(const char *payload, int len)
+{
+    if (!is_connected)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return publish(MQTT_TOPIC_REACTION_RESULT, 0, payload, len, 1, 0, 0, NULL, 0) >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Publish a telemetry snapshot
+ */
+esp_err_t mqtt_publish_telemetry(const char *payload, int len)
+{
+    if (!is_connected)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return publish(MQTT_TOPIC_TELEMETRY, 0, payload, len, 0, 0, 0, NULL, 0) >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Publish a CPU profile report
+ */
+esp_err_t mqtt_publish_profile(const char *payload, int len)
+{
+    if (!is_connected)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return publish(MQTT_TOPIC_PROFILE, 0, payload, len, 0, 0, 0, NULL, 0) >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Publish a chunk of trace records
+ */
+esp_err_t mqtt_publish_trace(const uint8_t *data, int len)
+{
+    if (!is_connected)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return publish(MQTT_TOPIC_TRACE, 0, (const char *)data, len, 0, 0, 0, NULL, 0) >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Get the number of bytes waiting in the esp-mqtt outbox
+ */
+int mqtt_get_outbox_size(void)
+{
+    return mqtt_client != NULL ? esp_mqtt_client_get_outbox_size(mqtt_client) : 0;
+}
+
 /**
  * Publish ACK for display message
  */
@@ -166,10 +1115,51 @@ void mqtt_publish_ack(void)
 {
     if (mqtt_client && is_connected)
     {
-        esp_mqtt_client_publish(mqtt_client, "game/ack", "OK", 0, 1, 0);
+        if (s_binary_topics & WIRE_TOPIC_ACK)
+        {
+            uint8_t ack[WIRE_ACK_SIZE];
+            size_t len = wire_encode_ack(ack, sizeof(ack));
+            publish(MQTT_TOPIC_ACK, 0, (const char *)ack, len, 1, 0, 0, NULL, 0);
+        }
+        else
+        {
+            publish(MQTT_TOPIC_ACK, 0, "OK", 0, 1, 0, 0, NULL, 0);
+        }
     }
 }
 
+/**
+ * Check whether a topic was negotiated to use the binary wire format
+ */
+bool mqtt_wire_is_binary(wire_topic_t topic)
+{
+    return (s_binary_topics & topic) != 0;
+}
+
+/**
+ * Get the arrival time of the message being handled
+ */
+int64_t mqtt_message_rx_time_us(void)
+{
+    return s_dispatch_rx_us;
+}
+
+/**
+ * Check whether the server acks button events
+ */
+bool mqtt_button_acks_enabled(void)
+{
+    return s_button_acks;
+}
+
+/**
+ * Check whether the capability reply is still due
+ */
+bool mqtt_caps_pending(void)
+{
+    return s_caps_pending && esp_timer_get_time() - s_caps_sent_us < MQTT_CAPS_REPLY_TIMEOUT_MS * 1000LL;
+}
+
 /**
  * Check if MQTT is connected
  * @return true if connected
@@ -0,0 +1,249 @@
+#include "profiler.h"
+#include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "static_alloc.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "PROFILER";
+
+static volatile bool s_requested = false;
+static volatile int s_core_load[portNUM_PROCESSORS];
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+typedef struct
+{
+    TaskHandle_t handle;
+    uint32_t runtime;
+} task_sample_t;
+
+typedef struct
+{
+    uint32_t total; // Run-time clock at the sample
+    uint32_t idle[portNUM_PROCESSORS];
+    uint32_t count;
+    task_sample_t tasks[PROFILER_MAX_TASKS];
+} sample_t;
+
+// One more slot than the window so the oldest sample is its starting point.
+// Everything here is allocated only while the profiler runs, unless
+// STATIC_MEMORY_MODE reserves it up front.
+#define RING_SLOTS (PROFILER_WINDOW_SAMPLES + 1)
+static sample_t *s_ring = NULL;
+static TaskStatus_t *s_status = NULL;
+#if STATIC_MEMORY_MODE
+static sample_t s_ring_buf[RING_SLOTS];
+static TaskStatus_t s_status_buf[PROFILER_MAX_TASKS];
+#endif
+static uint32_t s_head = 0;
+static uint32_t s_filled = 0;
+static uint32_t s_since_report = 0;
+
+static char s_report[512];
+
+static bool start(void)
+{
+#if STATIC_MEMORY_MODE
+    memset(s_ring_buf, 0, sizeof(s_ring_buf));
+    s_ring = s_ring_buf;
+    s_status = s_status_buf;
+#else
+    s_ring = (sample_t *)calloc(RING_SLOTS, sizeof(sample_t));
+    s_status = (TaskStatus_t *)malloc(PROFILER_MAX_TASKS * sizeof(TaskStatus_t));
+    if (s_ring == NULL || s_status == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate sample buffers");
+        free(s_ring);
+        free(s_status);
+        s_ring = NULL;
+        s_status = NULL;
+        s_requested = false;
+        return false;
+    }
+#endif
+    s_head = 0;
+    s_filled = 0;
+    s_since_report = 0;
+    ESP_LOGI(TAG, "Profiler started (%d s window)", PROFILER_WINDOW_SAMPLES);
+    return true;
+}
+
+static void stop(void)
+{
+#if !STATIC_MEMORY_MODE
+    free(s_ring);
+    free(s_status);
+#endif
+    s_ring = NULL;
+    s_status = NULL;
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+        s_core_load[core] = -1;
+    ESP_LOGI(TAG, "Profiler stopped");
+}
+
+static uint32_t runtime_in(const sample_t *sample, TaskHandle_t handle)
+{
+    for (uint32_t i = 0; i < sample->count; i++)
+    {
+        if (sample->tasks[i].handle == handle)
+            return sample->tasks[i].runtime;
+    }
+    // Created during the window
+    return 0;
+}
+
+/**
+ * Build the report from the newest sample, whose names are still in s_status:
+ * {"window_ms":<ms>,"cpu":[<core0 %>,<core1 %>],"tasks":{"<name>":<% of one core>,...}}
+ */
+static int format_report(const sample_t *newest, const sample_t *oldest, uint32_t elapsed)
+{
+    int len = snprintf(s_report, sizeof(s_report), "{\"window_ms\":%lu,\"cpu\":[", (unsigned long)(elapsed / 1000));
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        len += snprintf(s_report + len, sizeof(s_report) - len, "%s%d", core > 0 ? "," : "", s_core_load[core]);
+    }
+    len += snprintf(s_report + len, sizeof(s_report) - len, "],\"tasks\":{");
+
+    bool first = true;
+    for (uint32_t i = 0; i < newest->count && len < (int)sizeof(s_report); i++)
+    {
+        uint32_t used = newest->tasks[i].runtime - runtime_in(oldest, newest->tasks[i].handle);
+        uint32_t share_x10 = (uint32_t)((uint64_t)used * 1000 / elapsed);
+        if (share_x10 < PROFILER_MIN_SHARE_X10)
+            continue;
+        len += snprintf(s_report + len, sizeof(s_report) - len, "%s\"%s\":%lu.%lu",
+                        first ? "" : ",", s_status[i].pcTaskName,
+                        (unsigned long)(share_x10 / 10), (unsigned long)(share_x10 % 10));
+        first = false;
+    }
+    if (len < (int)sizeof(s_report))
+        len += snprintf(s_report + len, sizeof(s_report) - len, "}}");
+
+    return len < (int)sizeof(s_report) ? len : (int)sizeof(s_report) - 1;
+}
+
+void profiler_sample(void)
+{
+    if (!s_requested)
+    {
+        if (s_ring != NULL)
+            stop();
+        return;
+    }
+    if (s_ring == NULL && !start())
+        return;
+
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(s_status, PROFILER_MAX_TASKS, &total);
+    if (count == 0)
+    {
+        ESP_LOGW(TAG, "More than %d tasks, sample skipped", PROFILER_MAX_TASKS);
+        return;
+    }
+
+    sample_t *newest = &s_ring[s_head];
+    newest->total = total;
+    newest->count = count;
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+        newest->idle[core] = 0;
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        newest->tasks[i].handle = s_status[i].xHandle;
+        newest->tasks[i].runtime = s_status[i].ulRunTimeCounter;
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            if (s_status[i].xHandle == xTaskGetIdleTaskHandleForCore(core))
+                newest->idle[core] = s_status[i].ulRunTimeCounter;
+        }
+    }
+
+    s_head = (s_head + 1) % RING_SLOTS;
+    if (s_filled < RING_SLOTS)
+        s_filled++;
+    if (s_filled < RING_SLOTS)
+        return;
+
+    // After the wrap s_head points at the oldest sample
+    const sample_t *oldest = &s_ring[s_head];
+    uint32_t elapsed = newest->total - oldest->total;
+    if (elapsed == 0)
+        return;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        uint32_t idle = newest->idle[core] - oldest->idle[core];
+        s_core_load[core] = idle >= elapsed ? 0 : (int)(100 - (uint64_t)idle * 100 / elapsed);
+    }
+
+    // The load above slides every sample; a report goes out once per window
+    if (++s_since_report < PROFILER_WINDOW_SAMPLES)
+        return;
+    s_since_report = 0;
+
+    int len = format_report(newest, oldest, elapsed);
+    ESP_LOGI(TAG, "%s", s_report);
+    mqtt_publish_profile(s_report, len);
+}
+
+esp_err_t profiler_set_enabled(bool enabled)
+{
+    s_requested = enabled;
+    return ESP_OK;
+}
+
+#else
+
+void profiler_sample(void)
+{
+}
+
+esp_err_t profiler_set_enabled(bool enabled)
+{
+    if (enabled)
+    {
+        ESP_LOGW(TAG, "Enable CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS to use the profiler");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+#endif // CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+
+/**
+ * Handle {"enable":true|false}
+ */
+static void on_config_message(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx)
+{
+    cJSON *root = cJSON_ParseWithLength(payload, payload_len);
+    cJSON *enable_item = cJSON_GetObjectItem(root, "enable");
+    if (cJSON_IsBool(enable_item))
+    {
+        profiler_set_enabled(cJSON_IsTrue(enable_item));
+    }
+    cJSON_Delete(root);
+}
+
+esp_err_t profiler_init(void)
+{
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+        s_core_load[core] = -1;
+    return mqtt_register_handler(MQTT_TOPIC_PROFILER_CONFIG, 0, on_config_message, NULL, 10);
+}
+
+bool profiler_is_enabled(void)
+{
+    return s_requested;
+}
+
+int profiler_get_core_load(int core)
+{
+    if (core < 0 || core >= portNUM_PROCESSORS)
+        return -1;
+    return s_core_load[core];
+}
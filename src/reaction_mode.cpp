@@ -0,0 +1,230 @@
+#include "reaction_mode.h"
+#include "button_manager.h"
+#include "buzzer_manager.h"
+#include "led_manager.h"
+#include "clock_sync.h"
+#include "cue_scheduler.h"
+#include "mqtt_manager.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <stdio.h>
+
+static const char *TAG = "REACTION";
+
+typedef enum
+{
+    ROUND_IDLE,
+    ROUND_ARMED,   // Waiting for the stimulus, presses are false starts
+    ROUND_RUNNING, // Stimulus emitted, timing presses
+} round_state_t;
+
+// Shared between the MQTT worker (arm), the cue task (stimulus) and the
+// main loop (presses, poll)
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static round_state_t s_state = ROUND_IDLE;
+static uint32_t s_round_id = 0;
+static uint32_t s_timeout_ms = REACTION_DEFAULT_TIMEOUT_MS;
+static int64_t s_armed_us = 0;
+static int64_t s_stimulus_us = 0;
+static int64_t s_press_us[REACTION_PLAYERS];
+static bool s_false_start[REACTION_PLAYERS];
+
+typedef struct
+{
+    uint32_t round_id;
+    int64_t stimulus_us;
+    int64_t press_us[REACTION_PLAYERS];
+    bool false_start[REACTION_PLAYERS];
+} round_snapshot_t;
+
+// Last result, kept until it could be published
+static char s_result[192];
+static int s_result_len = 0;
+
+static reaction_wake_t s_wake = NULL;
+
+/**
+ * Handle {"round":<n>,"timeout_ms":<ms>,"at":<server us>}
+ * Without "at" the stimulus is expected as a REACTION cue or sound.
+ */
+static void on_reaction_message(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx)
+{
+    cJSON *root = cJSON_ParseWithLength(payload, payload_len);
+    cJSON *round_item = cJSON_GetObjectItem(root, "round");
+    if (!cJSON_IsNumber(round_item))
+    {
+        ESP_LOGW(TAG, "Invalid reaction message");
+        cJSON_Delete(root);
+        return;
+    }
+
+    cJSON *timeout_item = cJSON_GetObjectItem(root, "timeout_ms");
+    cJSON *at_item = cJSON_GetObjectItem(root, "at");
+    uint32_t round_id = (uint32_t)round_item->valuedouble;
+
+    reaction_arm(round_id, cJSON_IsNumber(timeout_item) ? (uint32_t)timeout_item->valuedouble : REACTION_DEFAULT_TIMEOUT_MS);
+    if (cJSON_IsNumber(at_item))
+    {
+        cue_schedule(round_id, "REACTION", 8, (int64_t)at_item->valuedouble);
+    }
+    cJSON_Delete(root);
+}
+
+esp_err_t reaction_init(reaction_wake_t wake)
+{
+    s_wake = wake;
+    return mqtt_register_handler(MQTT_TOPIC_REACTION, 1, on_reaction_message, NULL, 20);
+}
+
+void reaction_arm(uint32_t round_id, uint32_t timeout_ms)
+{
+    taskENTER_CRITICAL(&s_mux);
+    s_state = ROUND_ARMED;
+    s_round_id = round_id;
+    s_timeout_ms = timeout_ms;
+    s_armed_us = esp_timer_get_time();
+    s_stimulus_us = 0;
+    for (int i = 0; i < REACTION_PLAYERS; i++)
+    {
+        s_press_us[i] = 0;
+        s_false_start[i] = false;
+    }
+    taskEXIT_CRITICAL(&s_mux);
+
+    ESP_LOGI(TAG, "Round %lu armed (timeout %lu ms)", (unsigned long)round_id, (unsigned long)timeout_ms);
+    if (s_wake != NULL)
+    {
+        s_wake();
+    }
+}
+
+void reaction_fire_stimulus(void)
+{
+    // LEDs switch first: a GPIO write is the most predictable edge we have
+    led_set_all(true, true, true);
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_mux);
+    if (s_state == ROUND_ARMED)
+    {
+        s_state = ROUND_RUNNING;
+        s_stimulus_us = now;
+    }
+    taskEXIT_CRITICAL(&s_mux);
+
+    buzzer_tone(NOTE_C7, 150);
+    led_set_all(false, false, false);
+}
+
+bool reaction_handle_press(uint8_t btn, int64_t time_us)
+{
+    if (btn < 1 || btn > REACTION_PLAYERS)
+        return false;
+
+    int i = btn - 1;
+    bool consumed = false;
+    taskENTER_CRITICAL(&s_mux);
+    if (s_state != ROUND_IDLE)
+    {
+        consumed = true;
+        // Only a player's first press counts
+        if (s_press_us[i] == 0 && !s_false_start[i])
+        {
+            if (s_state == ROUND_ARMED || time_us < s_stimulus_us)
+                s_false_start[i] = true;
+            else
+                s_press_us[i] = time_us;
+        }
+    }
+    taskEXIT_CRITICAL(&s_mux);
+    return consumed;
+}
+
+/**
+ * Build the round result:
+ * {"round":<n>,"stimulus":<server us>,"err_us":<n>,"players":{"meeple_1":<us>|"false_start"|"none",...}}
+ */
+static void format_result(const round_snapshot_t *round)
+{
+    int len = snprintf(s_result, sizeof(s_result), "{\"round\":%lu", (unsigned long)round->round_id);
+
+    int64_t stimulus_server_us = 0;
+    uint32_t error_us = 0;
+    if (round->stimulus_us != 0 && clock_sync_to_server_us(round->stimulus_us, &stimulus_server_us, &error_us) == ESP_OK)
+    {
+        len += snprintf(s_result + len, sizeof(s_result) - len, ",\"stimulus\":%lld,\"err_us\":%lu",
+                        stimulus_server_us, (unsigned long)error_us);
+    }
+
+    len += snprintf(s_result + len, sizeof(s_result) - len, ",\"players\":{");
+    for (int i = 0; i < REACTION_PLAYERS; i++)
+    {
+        const char *sep = i > 0 ? "," : "";
+        const char *player = button_player_id(i + 1);
+        if (round->false_start[i])
+            len += snprintf(s_result + len, sizeof(s_result) - len, "%s\"%s\":\"false_start\"", sep, player);
+        else if (round->press_us[i] != 0)
+            len += snprintf(s_result + len, sizeof(s_result) - len, "%s\"%s\":%lld", sep, player, round->press_us[i] - round->stimulus_us);
+        else
+            len += snprintf(s_result + len, sizeof(s_result) - len, "%s\"%s\":\"none\"", sep, player);
+    }
+    len += snprintf(s_result + len, sizeof(s_result) - len, "}}");
+    s_result_len = len < (int)sizeof(s_result) ? len : (int)sizeof(s_result) - 1;
+}
+
+bool reaction_poll(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    round_snapshot_t round;
+    taskENTER_CRITICAL(&s_mux);
+    bool done = false;
+    if (s_state == ROUND_RUNNING)
+    {
+        bool all_in = true;
+        for (int i = 0; i < REACTION_PLAYERS; i++)
+        {
+            if (s_press_us[i] == 0 && !s_false_start[i])
+                all_in = false;
+        }
+        done = all_in || now - s_stimulus_us >= (int64_t)s_timeout_ms * 1000;
+    }
+    else if (s_state == ROUND_ARMED)
+    {
+        done = now - s_armed_us >= (int64_t)REACTION_MAX_ARMED_MS * 1000;
+    }
+
+    if (done)
+    {
+        round.round_id = s_round_id;
+        round.stimulus_us = s_stimulus_us;
+        for (int i = 0; i < REACTION_PLAYERS; i++)
+        {
+            round.press_us[i] = s_press_us[i];
+            round.false_start[i] = s_false_start[i];
+        }
+        s_state = ROUND_IDLE;
+    }
+    taskEXIT_CRITICAL(&s_mux);
+
+    if (done)
+    {
+        format_result(&round);
+        ESP_LOGI(TAG, "Round result: %s", s_result);
+    }
+
+    // Retried on every poll until the broker takes it
+    if (s_result_len > 0 && mqtt_publish_reaction_result(s_result, s_result_len) == ESP_OK)
+    {
+        s_result_len = 0;
+    }
+    return s_state != ROUND_IDLE || s_result_len > 0;
+}
+
+bool reaction_is_active(void)
+{
+    return s_state != ROUND_IDLE;
+}
@@ -0,0 +1,316 @@
+#include "telemetry.h"
+#include "profiler.h"
+#include "button_manager.h"
+#include "button_outbox.h"
+#include "mqtt_manager.h"
+#include "wifi_manager.h"
+#include "game_mode.h"
+#include "heap_guard.h"
+#include "json_arena.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "static_alloc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+static const char *TAG = "TELEMETRY";
+
+// Tasks whose stack high-water marks are reported. Handles are looked up by
+// name on first use since most modules keep theirs private.
+static const char *const STACK_TASKS[] = {
+    "main", "mqtt_task", "mqtt_worker", "outbox", "clock_sync", "cue", "telemetry", "fx_sound", "fx_sequence"};
+#define STACK_TASK_COUNT (sizeof(STACK_TASKS) / sizeof(STACK_TASKS[0]))
+// Walking a stack for its high-water mark is the one non-trivial sample
+#define STACK_CHECK_SAMPLES 10
+
+static TaskHandle_t s_stack_handles[STACK_TASK_COUNT];
+static uint32_t s_stack_free[STACK_TASK_COUNT];
+
+STATIC_TASK_BUFFERS(s_task, TELEMETRY_TASK_STACK_SIZE);
+
+static volatile uint32_t s_interval_ms = TELEMETRY_DEFAULT_INTERVAL_MS;
+static volatile bool s_snapshot_requested = false;
+
+// Peaks since the last snapshot, so short bursts between snapshots still show
+static uint32_t s_button_queue_peak = 0;
+static uint32_t s_outbox_peak = 0;
+static uint32_t s_worker_pending_peak = 0;
+static uint32_t s_worker_dropped_seen = 0;
+static uint32_t s_firmware_allocs_seen = 0;
+
+static char s_snapshot[576];
+
+static void sample_stacks(void)
+{
+    for (size_t i = 0; i < STACK_TASK_COUNT; i++)
+    {
+        if (s_stack_handles[i] == NULL)
+        {
+            s_stack_handles[i] = xTaskGetHandle(STACK_TASKS[i]);
+        }
+        // High-water marks are in bytes on ESP-IDF
+        s_stack_free[i] = s_stack_handles[i] != NULL ? uxTaskGetStackHighWaterMark(s_stack_handles[i]) : 0;
+    }
+}
+
+/**
+ * Take the cheap samples and work out which alerts, if any, have tripped
+ */
+static uint32_t sample(bool check_stacks)
+{
+    uint32_t alerts = TELEMETRY_ALERT_NONE;
+
+    if (esp_get_free_heap_size() < TELEMETRY_LOW_HEAP_BYTES)
+        alerts |= TELEMETRY_ALERT_LOW_HEAP;
+
+    uint32_t button_queue = button_get_queue_depth();
+    if (button_queue > s_button_queue_peak)
+        s_button_queue_peak = button_queue;
+    if (button_queue * 100 >= BUTTON_QUEUE_LENGTH * TELEMETRY_QUEUE_ALERT_PERCENT)
+        alerts |= TELEMETRY_ALERT_BUTTON_QUEUE;
+
+    outbox_metrics_t outbox;
+    outbox_get_metrics(&outbox);
+    if (outbox.depth > s_outbox_peak)
+        s_outbox_peak = outbox.depth;
+    if (outbox.depth * 100 >= OUTBOX_CAPACITY * TELEMETRY_QUEUE_ALERT_PERCENT)
+        alerts |= TELEMETRY_ALERT_OUTBOX;
+
+    mqtt_worker_stats_t worker;
+    mqtt_get_worker_stats(&worker);
+    uint32_t pending = worker.queued - worker.processed;
+    if (pending > s_worker_pending_peak)
+        s_worker_pending_peak = pending;
+    if (worker.dropped != s_worker_dropped_seen)
+    {
+        // The ring was full: messages have already been lost
+        s_worker_dropped_seen = worker.dropped;
+        alerts |= TELEMETRY_ALERT_MQTT_WORKER;
+    }
+
+    wifi_link_quality_t link;
+    wifi_get_link_quality(&link);
+    if (link.level == WIFI_LINK_POOR)
+        alerts |= TELEMETRY_ALERT_POOR_LINK;
+
+#if STATIC_MEMORY_MODE
+    heap_guard_stats_t heap;
+    heap_guard_get_stats(&heap);
+    if (heap.firmware_allocs != s_firmware_allocs_seen)
+    {
+        s_firmware_allocs_seen = heap.firmware_allocs;
+        alerts |= TELEMETRY_ALERT_HEAP_ALLOC;
+    }
+#endif
+
+    if (check_stacks)
+    {
+        sample_stacks();
+        for (size_t i = 0; i < STACK_TASK_COUNT; i++)
+        {
+            if (s_stack_handles[i] != NULL && s_stack_free[i] < TELEMETRY_LOW_STACK_BYTES)
+                alerts |= TELEMETRY_ALERT_LOW_STACK;
+        }
+    }
+    return alerts;
+}
+
+/**
+ * Append to s_snapshot at *len
+ * Once the buffer is full, *len stays at its size and later appends do
+ * nothing, so callers need no bounds check of their own.
+ */
+static void append(int *len, const char *fmt, ...)
+{
+    if (*len >= (int)sizeof(s_snapshot))
+        return;
+    va_list args;
+    va_start(args, fmt);
+    int written = vsnprintf(s_snapshot + *len, sizeof(s_snapshot) - *len, fmt, args);
+    va_end(args);
+    *len = written < 0 ? (int)sizeof(s_snapshot) : *len + written;
+    if (*len > (int)sizeof(s_snapshot))
+        *len = (int)sizeof(s_snapshot);
+}
+
+/**
+ * Build a compact snapshot:
+ * {"up":<s>,"boot_ip_ms":<ms>,"heap":<b>,"heap_min":<b>,"rssi":<dBm>,
+ *  "link":<0-100>,"disc":<n>,"reason":<wifi reason>,"mode":"<mode>","ps":"<profile>","rtt_us":[<min>,<avg>,<max>],"btn_q":<n>,"outbox":<n>,
+ *  "mqtt_ob":<b>,"rx_pending":<n>,"rx_dropped":<n>,"stacks":{"<task>":<b>,...},"allocs":[<all>,<firmware>],"json":[<b>,<overflows>],"cpu":[<%>,<%>],"alert":<mask>}
+ */
+static int format_snapshot(uint32_t alerts)
+{
+    mqtt_worker_stats_t worker;
+    mqtt_get_worker_stats(&worker);
+
+    int8_t rssi = 0;
+    bool have_rssi = wifi_get_rssi(&rssi) == ESP_OK;
+
+    wifi_connect_stats_t wifi;
+    wifi_get_connect_stats(&wifi);
+
+    int len = 0;
+    append(&len, "{\"up\":%lu,\"boot_ip_ms\":%lu,\"heap\":%lu,\"heap_min\":%lu",
+           (unsigned long)(esp_timer_get_time() / 1000000),
+           (unsigned long)(wifi.boot_to_ip_us / 1000),
+           (unsigned long)esp_get_free_heap_size(),
+           (unsigned long)esp_get_minimum_free_heap_size());
+    if (have_rssi)
+        append(&len, ",\"rssi\":%d", rssi);
+
+    wifi_link_quality_t link;
+    wifi_get_link_quality(&link);
+    append(&len, ",\"link\":%u,\"disc\":%lu,\"reason\":%u",
+           link.score, (unsigned long)link.disconnects, link.last_reason);
+
+    wifi_latency_profile_t profile = wifi_get_latency_profile();
+    wifi_rtt_stats_t rtt;
+    wifi_get_rtt_stats(profile, &rtt);
+    append(&len, ",\"mode\":\"%s\",\"ps\":\"%s\"", game_mode_profile()->name, wifi_profile_name(profile));
+    if (rtt.samples > 0)
+        append(&len, ",\"rtt_us\":[%lu,%lu,%lu]",
+               (unsigned long)rtt.min_us, (unsigned long)rtt.avg_us, (unsigned long)rtt.max_us);
+    append(&len, ",\"btn_q\":%lu,\"outbox\":%lu,\"mqtt_ob\":%d,\"rx_pending\":%lu,\"rx_dropped\":%lu,\"stacks\":{",
+           (unsigned long)s_button_queue_peak, (unsigned long)s_outbox_peak,
+           mqtt_get_outbox_size(), (unsigned long)s_worker_pending_peak, (unsigned long)worker.dropped);
+
+    bool first = true;
+    for (size_t i = 0; i < STACK_TASK_COUNT; i++)
+    {
+        if (s_stack_handles[i] == NULL)
+            continue;
+        append(&len, "%s\"%s\":%lu", first ? "" : ",", STACK_TASKS[i], (unsigned long)s_stack_free[i]);
+        first = false;
+    }
+    append(&len, "}");
+
+    // Heap allocations since boot, once the guard is armed
+    heap_guard_stats_t heap;
+    heap_guard_get_stats(&heap);
+    if (heap.armed)
+        append(&len, ",\"allocs\":[%lu,%lu]", (unsigned long)heap.allocs, (unsigned long)heap.firmware_allocs);
+
+    json_arena_stats_t arena;
+    json_arena_get_stats(&arena);
+    append(&len, ",\"json\":[%lu,%lu]", (unsigned long)arena.high_water, (unsigned long)arena.overflows);
+
+    // Core loads only while the profiler runs
+    if (profiler_get_core_load(0) >= 0)
+    {
+        append(&len, ",\"cpu\":[");
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+            append(&len, "%s%d", core > 0 ? "," : "", profiler_get_core_load(core));
+        append(&len, "]");
+    }
+    append(&len, ",\"alert\":%lu}", (unsigned long)alerts);
+
+    return len < (int)sizeof(s_snapshot) ? len : (int)sizeof(s_snapshot) - 1;
+}
+
+static void telemetry_task(void *pvParameters)
+{
+    uint32_t samples = 0;
+    int64_t last_snapshot_us = esp_timer_get_time();
+    int64_t last_alert_us = 0;
+    uint32_t reported_alerts = TELEMETRY_ALERT_NONE;
+
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_SAMPLE_MS));
+        int64_t now = esp_timer_get_time();
+        uint32_t interval_ms = s_interval_ms;
+
+        profiler_sample();
+
+        bool due = interval_ms > 0 && now - last_snapshot_us >= (int64_t)interval_ms * 1000;
+        uint32_t alerts = sample(due || ++samples % STACK_CHECK_SAMPLES == 0);
+
+        // A new kind of alert goes out at once; a standing one is repeated at
+        // most every holdoff so a saturated base does not flood the broker
+        bool alert_due = alerts != TELEMETRY_ALERT_NONE &&
+                         ((alerts & ~reported_alerts) != 0 ||
+                          now - last_alert_us >= (int64_t)TELEMETRY_ALERT_HOLDOFF_MS * 1000);
+        if (!due && !alert_due && !s_snapshot_requested)
+            continue;
+        if (!mqtt_is_connected())
+            continue;
+
+        if (alerts != TELEMETRY_ALERT_NONE && !due)
+        {
+            // Stack marks may be stale by up to STACK_CHECK_SAMPLES
+            sample_stacks();
+        }
+
+        int len = format_snapshot(alerts);
+        if (mqtt_publish_telemetry(s_snapshot, len) != ESP_OK)
+            continue;
+
+        if (alerts != TELEMETRY_ALERT_NONE)
+        {
+            ESP_LOGW(TAG, "Health alert 0x%02lx: %s", (unsigned long)alerts, s_snapshot);
+            last_alert_us = now;
+        }
+        reported_alerts = alerts;
+        last_snapshot_us = now;
+        s_snapshot_requested = false;
+        s_button_queue_peak = 0;
+        s_outbox_peak = 0;
+        s_worker_pending_peak = 0;
+    }
+}
+
+/**
+ * A change in link level goes out with the next sample rather than the next interval
+ */
+static void on_link_change(const wifi_link_quality_t *quality, void *ctx)
+{
+    telemetry_request_snapshot();
+}
+
+/**
+ * Handle {"interval_ms":<ms>} and/or {"now":true}
+ */
+static void on_config_message(const char *topic, int topic_len, const char *payload, int payload_len, void *ctx)
+{
+    cJSON *root = cJSON_ParseWithLength(payload, payload_len);
+    cJSON *interval_item = cJSON_GetObjectItem(root, "interval_ms");
+    if (cJSON_IsNumber(interval_item) && interval_item->valuedouble >= 0)
+    {
+        telemetry_set_interval((uint32_t)interval_item->valuedouble);
+        ESP_LOGI(TAG, "Interval set to %lu ms", (unsigned long)s_interval_ms);
+    }
+    if (cJSON_IsTrue(cJSON_GetObjectItem(root, "now")))
+    {
+        telemetry_request_snapshot();
+    }
+    cJSON_Delete(root);
+}
+
+esp_err_t telemetry_init(void)
+{
+    if (STATIC_TASK_CREATE(s_task, telemetry_task, "telemetry", TELEMETRY_TASK_STACK_SIZE, NULL, TELEMETRY_TASK_PRIORITY) == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create task");
+        return ESP_FAIL;
+    }
+
+    mqtt_register_handler(MQTT_TOPIC_TELEMETRY_CONFIG, 0, on_config_message, NULL, 10);
+    wifi_link_subscribe(on_link_change, NULL);
+    ESP_LOGI(TAG, "Telemetry started (every %lu ms)", (unsigned long)s_interval_ms);
+    return ESP_OK;
+}
+
+void telemetry_set_interval(uint32_t interval_ms)
+{
+    s_interval_ms = interval_ms;
+}
+
+void telemetry_request_snapshot(void)
+{
+    s_snapshot_requested = true;
+}
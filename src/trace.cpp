@@ -0,0 +1,145 @@
+#include "trace.h"
+#include "mqtt_manager.h"
+#include "command_table.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <atomic>
+#include <stdio.h>
+
+static const char *TAG = "TRACE";
+
+static_assert(sizeof(trace_record_t) == 16, "Trace records must stay 16 bytes");
+static_assert((TRACE_CAPACITY & (TRACE_CAPACITY - 1)) == 0, "TRACE_CAPACITY must be a power of two");
+
+// Writers claim a slot with one atomic add and fill it in place; nothing
+// blocks, so ISRs on either core can record. Dumps pause recording first.
+static trace_record_t s_ring[TRACE_CAPACITY];
+static std::atomic<uint32_t> s_head{0}; // Records ever claimed
+static volatile bool s_enabled = TRACE_START_ENABLED;
+
+void IRAM_ATTR trace_record(uint16_t id, uint32_t arg0, uint32_t arg1)
+{
+    if (!s_enabled)
+        return;
+
+    uint32_t index = s_head.fetch_add(1, std::memory_order_relaxed);
+    trace_record_t *record = &s_ring[index & (TRACE_CAPACITY - 1)];
+    record->time_us = (uint32_t)esp_timer_get_time();
+    record->id = id;
+    record->core = (uint8_t)xPortGetCoreID();
+    record->isr = xPortInIsrContext() ? 1 : 0;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+}
+
+void trace_set_enabled(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+/**
+ * Stop recording and let writers that already claimed a slot finish
+ * @return Whether recording was on
+ */
+static bool pause(void)
+{
+    bool was_enabled = s_enabled;
+    s_enabled = false;
+    vTaskDelay(1);
+    return was_enabled;
+}
+
+void trace_clear(void)
+{
+    bool was_enabled = pause();
+    s_head.store(0, std::memory_order_relaxed);
+    s_enabled = was_enabled;
+}
+
+/**
+ * Get the oldest record index and the record count
+ */
+static uint32_t ring_span(uint32_t *first)
+{
+    uint32_t head = s_head.load(std::memory_order_relaxed);
+    uint32_t count = head < TRACE_CAPACITY ? head : TRACE_CAPACITY;
+    *first = head - count;
+    return count;
+}
+
+void trace_dump_uart(void)
+{
+    bool was_enabled = pause();
+
+    uint32_t first;
+    uint32_t count = ring_span(&first);
+    ESP_LOGI(TAG, "Dumping %lu records", (unsigned long)count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint8_t *bytes = (const uint8_t *)&s_ring[(first + i) & (TRACE_CAPACITY - 1)];
+        char line[2 * sizeof(trace_record_t) + 1];
+        for (size_t b = 0; b < sizeof(trace_record_t); b++)
+            snprintf(&line[2 * b], 3, "%02x", bytes[b]);
+        printf("TRACE:%s\n", line);
+    }
+
+    s_enabled = was_enabled;
+}
+
+esp_err_t trace_dump_mqtt(void)
+{
+    if (!mqtt_is_connected())
+        return ESP_ERR_INVALID_STATE;
+
+    bool was_enabled = pause();
+
+    uint32_t first;
+    uint32_t count = ring_span(&first);
+    esp_err_t err = ESP_OK;
+    for (uint32_t sent = 0; sent < count && err == ESP_OK;)
+    {
+        // Send straight from the ring, stopping at the wrap
+        uint32_t slot = (first + sent) & (TRACE_CAPACITY - 1);
+        uint32_t n = count - sent;
+        if (n > TRACE_DUMP_CHUNK)
+            n = TRACE_DUMP_CHUNK;
+        if (n > TRACE_CAPACITY - slot)
+            n = TRACE_CAPACITY - slot;
+
+        err = mqtt_publish_trace((const uint8_t *)&s_ring[slot], n * sizeof(trace_record_t));
+        sent += n;
+    }
+    ESP_LOGI(TAG, "Published %lu records", (unsigned long)count);
+
+    s_enabled = was_enabled;
+    return err;
+}
+
+static void start_trace(void) { trace_set_enabled(true); }
+static void stop_trace(void) { trace_set_enabled(false); }
+static void dump_mqtt(void) { trace_dump_mqtt(); }
+
+static constexpr command_t TRACE_COMMANDS[] = {
+    {"START", start_trace},
+    {"STOP", stop_trace},
+    {"CLEAR", trace_clear},
+    {"DUMP", dump_mqtt},
+    {"DUMP_UART", trace_dump_uart},
+};
+static constexpr CommandTable s_trace_commands(TRACE_COMMANDS);
+static_assert(s_trace_commands.is_perfect(), "Trace command names must be unique");
+
+static void on_trace_message(const char *topic, int topic_len, const char *payload, int len, void *ctx)
+{
+    if (!s_trace_commands.dispatch(payload, len))
+    {
+        ESP_LOGW(TAG, "Unknown trace command: %.*s", len, payload);
+    }
+}
+
+esp_err_t trace_init(void)
+{
+    return mqtt_register_handler(MQTT_TOPIC_TRACE_CONFIG, 1, on_trace_message, NULL, 3000);
+}
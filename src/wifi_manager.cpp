@@ -2,15 +2,19 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "static_alloc.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include <string.h>
 
 static EventGroupHandle_t s_wifi_event_group;
+STATIC_EVENT_GROUP_BUFFERS(s_wifi_event_group);
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 
@@ -18,6 +22,309 @@ static const char *TAG = "wifi_manager";
 static int s_retry_num = 0;
 static wifi_status_t s_wifi_status = WIFI_STATUS_DISCONNECTED;
 static char s_ip_addr[16] = "0.0.0.0";
+static esp_netif_t *s_netif = NULL;
+
+// Last good connection, saved to NVS whenever it changes
+#define WIFI_CACHE_VERSION 1
+typedef struct
+{
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[33];
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} wifi_cache_t;
+
+static wifi_cache_t s_cache;
+static bool s_cache_valid = false;
+// True while the first connect uses the cached AP; cleared on fallback
+static bool s_fast_connect = false;
+// True while the STA config is pinned to the cached BSSID and channel
+static bool s_pinned = false;
+static wifi_connect_stats_t s_stats;
+
+static const wifi_ps_type_t PROFILE_PS_MODES[WIFI_PROFILE_COUNT] = {
+    WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM};
+static const char *const PROFILE_NAMES[WIFI_PROFILE_COUNT] = {
+    "low_latency", "balanced", "power_save"};
+static wifi_latency_profile_t s_profile = WIFI_PROFILE_BALANCED;
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} rtt_accumulator_t;
+
+// Fed from the clock sync task, read from telemetry
+static portMUX_TYPE s_rtt_mux = portMUX_INITIALIZER_UNLOCKED;
+static rtt_accumulator_t s_rtt[WIFI_PROFILE_COUNT];
+
+static esp_timer_handle_t s_retry_timer = NULL;
+static bool s_manual_disconnect = false;
+
+// Link state is written from the event loop and the sample timer
+#define DISCONNECT_HISTORY 8
+static portMUX_TYPE s_link_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_link_timer = NULL;
+static wifi_link_quality_t s_link = {};
+static bool s_rssi_valid = false;
+static int64_t s_disconnect_us[DISCONNECT_HISTORY];
+static uint32_t s_disconnect_head = 0;
+
+typedef struct
+{
+    wifi_link_cb_t cb;
+    void *ctx;
+} link_subscriber_t;
+
+static link_subscriber_t s_link_subscribers[WIFI_LINK_MAX_SUBSCRIBERS];
+static int s_link_subscriber_count = 0;
+
+static wifi_link_level_t level_for_score(uint8_t score)
+{
+    if (score >= WIFI_LINK_SCORE_GOOD)
+        return WIFI_LINK_GOOD;
+    if (score >= WIFI_LINK_SCORE_FAIR)
+        return WIFI_LINK_FAIR;
+    return WIFI_LINK_POOR;
+}
+
+/**
+ * Recompute the score; call with s_link_mux held
+ * @return true if the level changed
+ */
+static bool update_link_locked(bool connected)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t recent = 0;
+    for (int i = 0; i < DISCONNECT_HISTORY; i++)
+    {
+        if (s_disconnect_us[i] != 0 && now - s_disconnect_us[i] < (int64_t)WIFI_LINK_DISCONNECT_WINDOW_MS * 1000)
+            recent++;
+    }
+    s_link.recent_disconnects = recent;
+
+    wifi_link_level_t previous = s_link.level;
+    if (!connected)
+    {
+        s_link.score = 0;
+        s_link.level = WIFI_LINK_DOWN;
+        return s_link.level != previous;
+    }
+
+    int score = 100;
+    if (s_rssi_valid)
+    {
+        score = (s_link.rssi - WIFI_LINK_RSSI_BAD) * 100 / (WIFI_LINK_RSSI_GOOD - WIFI_LINK_RSSI_BAD);
+        score = score < 0 ? 0 : score > 100 ? 100 : score;
+    }
+    score -= (int)recent * WIFI_LINK_DISCONNECT_PENALTY;
+    s_link.score = score < 0 ? 0 : (uint8_t)score;
+    s_link.level = level_for_score(s_link.score);
+    return s_link.level != previous;
+}
+
+static void notify_link_subscribers(const wifi_link_quality_t *quality)
+{
+    ESP_LOGI(TAG, "Link quality %u (RSSI %d dBm, %lu recent disconnects)",
+             quality->score, quality->rssi, (unsigned long)quality->recent_disconnects);
+    for (int i = 0; i < s_link_subscriber_count; i++)
+    {
+        s_link_subscribers[i].cb(quality, s_link_subscribers[i].ctx);
+    }
+}
+
+static void link_sample_callback(void *arg)
+{
+    int rssi = 0;
+    bool connected = s_wifi_status == WIFI_STATUS_CONNECTED && esp_wifi_sta_get_rssi(&rssi) == ESP_OK;
+
+    taskENTER_CRITICAL(&s_link_mux);
+    if (connected)
+    {
+        // Smooth out single-frame dips
+        s_link.rssi = s_rssi_valid ? (int8_t)((3 * s_link.rssi + rssi) / 4) : (int8_t)rssi;
+        s_rssi_valid = true;
+    }
+    bool changed = update_link_locked(connected);
+    wifi_link_quality_t quality = s_link;
+    taskEXIT_CRITICAL(&s_link_mux);
+
+    if (changed)
+        notify_link_subscribers(&quality);
+}
+
+static void note_disconnect(uint8_t reason)
+{
+    taskENTER_CRITICAL(&s_link_mux);
+    s_link.last_reason = reason;
+    s_link.disconnects++;
+    s_disconnect_us[s_disconnect_head] = esp_timer_get_time();
+    s_disconnect_head = (s_disconnect_head + 1) % DISCONNECT_HISTORY;
+    s_rssi_valid = false;
+    bool changed = update_link_locked(false);
+    wifi_link_quality_t quality = s_link;
+    taskEXIT_CRITICAL(&s_link_mux);
+
+    if (changed)
+        notify_link_subscribers(&quality);
+}
+
+static void retry_timer_callback(void *arg)
+{
+    if (!s_manual_disconnect)
+    {
+        esp_wifi_connect();
+    }
+}
+
+/**
+ * Try again after a jittered exponential backoff, so a flapping AP or a room
+ * full of bases rebooting together does not hammer the radio
+ */
+static void schedule_reconnect(void)
+{
+    uint32_t shift = s_retry_num < 16 ? (uint32_t)s_retry_num : 16;
+    uint64_t delay_ms = (uint64_t)WIFI_BACKOFF_BASE_MS << shift;
+    if (delay_ms > WIFI_BACKOFF_MAX_MS)
+        delay_ms = WIFI_BACKOFF_MAX_MS;
+    int64_t jitter = (int64_t)(delay_ms * WIFI_BACKOFF_JITTER_PERCENT / 100);
+    int64_t offset = jitter > 0 ? (int64_t)(esp_random() % (uint32_t)(2 * jitter + 1)) - jitter : 0;
+    delay_ms = (uint64_t)((int64_t)delay_ms + offset);
+
+    s_retry_num++;
+    if (s_retry_num == MAXIMUM_RETRY)
+    {
+        // Report the failure but keep trying at the slower pace
+        s_wifi_status = WIFI_STATUS_FAILED;
+        xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        ESP_LOGE(TAG, "Failed to connect after %d attempts", MAXIMUM_RETRY);
+    }
+
+    esp_timer_stop(s_retry_timer);
+    esp_timer_start_once(s_retry_timer, delay_ms * 1000);
+    ESP_LOGI(TAG, "Retry %d in %llu ms", s_retry_num, delay_ms);
+}
+
+static void load_cache(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return;
+    }
+    size_t len = sizeof(s_cache);
+    esp_err_t err = nvs_get_blob(handle, "cache", &s_cache, &len);
+    nvs_close(handle);
+
+    s_cache_valid = err == ESP_OK && len == sizeof(s_cache) &&
+                    s_cache.version == WIFI_CACHE_VERSION &&
+                    strcmp(s_cache.ssid, WIFI_SSID) == 0;
+}
+
+/**
+ * Record the AP and lease we just got, touching flash only if they changed
+ */
+static void save_cache(const esp_netif_ip_info_t *ip_info)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+    {
+        return;
+    }
+
+    wifi_cache_t cache = {};
+    cache.version = WIFI_CACHE_VERSION;
+    cache.channel = ap.primary;
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    strncpy(cache.ssid, WIFI_SSID, sizeof(cache.ssid) - 1);
+    cache.ip = ip_info->ip.addr;
+    cache.netmask = ip_info->netmask.addr;
+    cache.gw = ip_info->gw.addr;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK)
+    {
+        cache.dns = dns.ip.u_addr.ip4.addr;
+    }
+
+    if (s_cache_valid && memcmp(&cache, &s_cache, sizeof(cache)) == 0)
+    {
+        return;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return;
+    }
+    if (nvs_set_blob(handle, "cache", &cache, sizeof(cache)) == ESP_OK && nvs_commit(handle) == ESP_OK)
+    {
+        s_cache = cache;
+        s_cache_valid = true;
+        ESP_LOGI(TAG, "Cached AP on channel %d", cache.channel);
+    }
+    nvs_close(handle);
+}
+
+#if WIFI_USE_CACHED_IP
+static void apply_cached_ip(void)
+{
+    esp_netif_ip_info_t ip_info = {};
+    ip_info.ip.addr = s_cache.ip;
+    ip_info.netmask.addr = s_cache.netmask;
+    ip_info.gw.addr = s_cache.gw;
+
+    if (s_cache.ip == 0 || esp_netif_dhcpc_stop(s_netif) != ESP_OK)
+    {
+        return;
+    }
+    if (esp_netif_set_ip_info(s_netif, &ip_info) != ESP_OK)
+    {
+        esp_netif_dhcpc_start(s_netif);
+        return;
+    }
+    if (s_cache.dns != 0)
+    {
+        esp_netif_dns_info_t dns = {};
+        dns.ip.u_addr.ip4.addr = s_cache.dns;
+        dns.ip.type = ESP_IPADDR_TYPE_V4;
+        esp_netif_set_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+    s_stats.cached_ip = true;
+}
+#endif
+
+/**
+ * The cached AP did not answer: forget the BSSID and channel, go back to DHCP
+ * and let the next connect scan every channel
+ */
+static void fall_back_to_scan(void)
+{
+    s_fast_connect = false;
+    s_pinned = false;
+    s_stats.full_scans++;
+
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK)
+    {
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    }
+
+    if (s_stats.cached_ip)
+    {
+        esp_netif_dhcpc_start(s_netif);
+        s_stats.cached_ip = false;
+    }
+    ESP_LOGW(TAG, "Cached AP unreachable, scanning all channels");
+}
 
 /**
  * Used to handle WiFi events 
@@ -34,10 +341,32 @@ static void event_handler(void *arg, esp_event_base_t event_base,
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
-        // If we disconnect, retry indefinitely
-        esp_wifi_connect();
-        s_wifi_status = WIFI_STATUS_CONNECTING;
-        ESP_LOGI(TAG, "Retry connecting to AP...");
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        ESP_LOGW(TAG, "Disconnected (reason %d)", event->reason);
+        note_disconnect(event->reason);
+        if (s_wifi_status != WIFI_STATUS_FAILED)
+        {
+            s_wifi_status = s_manual_disconnect ? WIFI_STATUS_DISCONNECTED : WIFI_STATUS_CONNECTING;
+        }
+        if (s_manual_disconnect)
+        {
+            return;
+        }
+
+        if (s_fast_connect)
+        {
+            // The scan is the real first attempt, so no backoff yet
+            fall_back_to_scan();
+            esp_wifi_connect();
+            return;
+        }
+        if (s_pinned && s_retry_num > 0)
+        {
+            // A reconnect to the cached AP already failed; it may have moved
+            // channel or been replaced, so stop asking for that BSSID
+            fall_back_to_scan();
+        }
+        schedule_reconnect();
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
@@ -45,17 +374,29 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         esp_ip4addr_ntoa(&event->ip_info.ip, s_ip_addr, sizeof(s_ip_addr));
         ESP_LOGI(TAG, "Got IP: %s", s_ip_addr);
+        if (s_stats.boot_to_ip_us == 0)
+        {
+            s_stats.boot_to_ip_us = esp_timer_get_time();
+            s_stats.fast_connect_ok = s_fast_connect;
+            ESP_LOGI(TAG, "Boot to IP: %lld ms (%lld ms after start, %s)",
+                     s_stats.boot_to_ip_us / 1000, (s_stats.boot_to_ip_us - s_stats.start_us) / 1000,
+                     s_fast_connect ? "cached AP" : "scan");
+        }
+        s_fast_connect = false;
+        save_cache(&event->ip_info);
         s_retry_num = 0;
         s_wifi_status = WIFI_STATUS_CONNECTED;
+        xEventGroupClearBits(s_wifi_event_group, WIFI_FAIL_BIT);
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        link_sample_callback(NULL);
     }
 }
 
 /**
- * Initialize and connect to WiFi
+ * Initialize WiFi and start connecting in the background
  * @return ESP_OK on success
  */
-esp_err_t wifi_init_sta(void)
+esp_err_t wifi_start_sta(void)
 {
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
@@ -67,16 +408,29 @@ esp_err_t wifi_init_sta(void)
     ESP_ERROR_CHECK(ret);
 
     // Wifi boilerplate configuration
-    s_wifi_event_group = xEventGroupCreate();
+    s_wifi_event_group = STATIC_EVENT_GROUP_CREATE(s_wifi_event_group);
     if (s_wifi_event_group == NULL)
     {
         ESP_LOGE(TAG, "Failed to create event group");
         return ESP_FAIL;
     }
 
+    esp_timer_create_args_t retry_args = {};
+    retry_args.callback = retry_timer_callback;
+    retry_args.name = "wifi_retry";
+    esp_timer_create_args_t link_args = {};
+    link_args.callback = link_sample_callback;
+    link_args.name = "wifi_link";
+    if (esp_timer_create(&retry_args, &s_retry_timer) != ESP_OK ||
+        esp_timer_create(&link_args, &s_link_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create timers");
+        return ESP_FAIL;
+    }
+
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    s_netif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
@@ -90,12 +444,51 @@ esp_err_t wifi_init_sta(void)
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA_WPA2_PSK;
     wifi_config.sta.pmf_cfg.capable = false;
     wifi_config.sta.pmf_cfg.required = false;
+    wifi_config.sta.listen_interval = WIFI_LISTEN_INTERVAL;
+
+    // Go straight to the last AP on its channel; a failure falls back to a full scan
+    load_cache();
+    if (s_cache_valid)
+    {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        wifi_config.sta.channel = s_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        s_fast_connect = true;
+        s_pinned = true;
+        s_stats.fast_connect = true;
+#if WIFI_USE_CACHED_IP
+        apply_cached_ip();
+#endif
+    }
+    else
+    {
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        s_stats.full_scans++;
+    }
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    s_stats.start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
+    esp_wifi_set_ps(PROFILE_PS_MODES[s_profile]);
+    esp_timer_start_periodic(s_link_timer, (uint64_t)WIFI_LINK_SAMPLE_MS * 1000);
 
-    ESP_LOGI(TAG, "WiFi initialization finished, waiting for connection...");
+    ESP_LOGI(TAG, "WiFi initialization finished, connecting...");
+    return ESP_OK;
+}
+
+/**
+ * Initialize and connect to WiFi, blocking until connected
+ * @return ESP_OK on success
+ */
+esp_err_t wifi_init_sta(void)
+{
+    esp_err_t ret = wifi_start_sta();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
 
     // Wait until WiFi is connnected or has failed
     EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
@@ -143,12 +536,140 @@ esp_err_t wifi_get_ip(char *buffer, size_t len)
     return ESP_OK;
 }
 
+/**
+ * Get the signal strength of the current AP
+ */
+esp_err_t wifi_get_rssi(int8_t *rssi_out)
+{
+    if (rssi_out == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    wifi_ap_record_t ap;
+    esp_err_t err = esp_wifi_sta_get_ap_info(&ap);
+    if (err == ESP_OK)
+    {
+        *rssi_out = ap.rssi;
+    }
+    return err;
+}
+
+/**
+ * Get connection timing since boot
+ */
+void wifi_get_connect_stats(wifi_connect_stats_t *stats_out)
+{
+    if (stats_out != NULL)
+    {
+        *stats_out = s_stats;
+    }
+}
+
+/**
+ * Get the current link quality
+ */
+void wifi_get_link_quality(wifi_link_quality_t *quality_out)
+{
+    if (quality_out == NULL)
+    {
+        return;
+    }
+    taskENTER_CRITICAL(&s_link_mux);
+    *quality_out = s_link;
+    taskEXIT_CRITICAL(&s_link_mux);
+}
+
+/**
+ * Be told whenever the link level changes
+ */
+esp_err_t wifi_link_subscribe(wifi_link_cb_t cb, void *ctx)
+{
+    if (cb == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_link_subscriber_count >= WIFI_LINK_MAX_SUBSCRIBERS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    s_link_subscribers[s_link_subscriber_count].cb = cb;
+    s_link_subscribers[s_link_subscriber_count].ctx = ctx;
+    s_link_subscriber_count++;
+    return ESP_OK;
+}
+
+/**
+ * Switch the radio power-save profile
+ */
+esp_err_t wifi_set_latency_profile(wifi_latency_profile_t profile)
+{
+    if (profile >= WIFI_PROFILE_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (profile == s_profile)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t err = esp_wifi_set_ps(PROFILE_PS_MODES[profile]);
+    if (err == ESP_OK)
+    {
+        s_profile = profile;
+        ESP_LOGI(TAG, "Latency profile: %s", PROFILE_NAMES[profile]);
+    }
+    return err;
+}
+
+wifi_latency_profile_t wifi_get_latency_profile(void)
+{
+    return s_profile;
+}
+
+const char *wifi_profile_name(wifi_latency_profile_t profile)
+{
+    return profile < WIFI_PROFILE_COUNT ? PROFILE_NAMES[profile] : "unknown";
+}
+
+void wifi_record_rtt(uint32_t rtt_us)
+{
+    taskENTER_CRITICAL(&s_rtt_mux);
+    rtt_accumulator_t *acc = &s_rtt[s_profile];
+    if (acc->samples == 0 || rtt_us < acc->min_us)
+        acc->min_us = rtt_us;
+    if (rtt_us > acc->max_us)
+        acc->max_us = rtt_us;
+    acc->total_us += rtt_us;
+    acc->samples++;
+    taskEXIT_CRITICAL(&s_rtt_mux);
+}
+
+void wifi_get_rtt_stats(wifi_latency_profile_t profile, wifi_rtt_stats_t *stats_out)
+{
+    if (stats_out == NULL || profile >= WIFI_PROFILE_COUNT)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_rtt_mux);
+    rtt_accumulator_t acc = s_rtt[profile];
+    taskEXIT_CRITICAL(&s_rtt_mux);
+
+    stats_out->samples = acc.samples;
+    stats_out->min_us = acc.min_us;
+    stats_out->max_us = acc.max_us;
+    stats_out->avg_us = acc.samples > 0 ? (uint32_t)(acc.total_us / acc.samples) : 0;
+}
+
 /**
  * Disconnect from WiFi
  * @return ESP_OK on success
  */
 esp_err_t wifi_disconnect(void)
 {
+    s_manual_disconnect = true;
+    esp_timer_stop(s_retry_timer);
     return esp_wifi_disconnect();
 }
 
@@ -158,6 +679,8 @@ esp_err_t wifi_disconnect(void)
  */
 esp_err_t wifi_reconnect(void)
 {
+    s_manual_disconnect = false;
     s_retry_num = 0;
+    esp_timer_stop(s_retry_timer);
     return esp_wifi_connect();
 }
\ No newline at end of file
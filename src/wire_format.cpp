@@ -0,0 +1,102 @@
+#include "wire_format.h"
+#include <string.h>
+
+static void put_le32(uint8_t *buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        buf[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static void put_le64(uint8_t *buf, int64_t value)
+{
+    uint64_t v = (uint64_t)value;
+    for (int i = 0; i < 8; i++)
+    {
+        buf[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+size_t wire_encode_button(uint8_t *buf, size_t cap, uint8_t button, uint32_t session, uint32_t seq, int64_t timestamp_ms, int32_t error_ms)
+{
+    if (buf == NULL || cap < WIRE_BUTTON_SIZE)
+        return 0;
+
+    buf[0] = WIRE_VERSION;
+    buf[1] = WIRE_MSG_BUTTON;
+    buf[2] = button;
+    if (error_ms < 0)
+        buf[3] = WIRE_ERR_UNSYNCED;
+    else
+        buf[3] = error_ms < WIRE_ERR_UNSYNCED ? (uint8_t)error_ms : WIRE_ERR_UNSYNCED - 1;
+    put_le32(&buf[4], session);
+    put_le32(&buf[8], seq);
+    put_le64(&buf[12], timestamp_ms);
+    return WIRE_BUTTON_SIZE;
+}
+
+size_t wire_encode_ack(uint8_t *buf, size_t cap)
+{
+    if (buf == NULL || cap < WIRE_ACK_SIZE)
+        return 0;
+
+    buf[0] = WIRE_VERSION;
+    buf[1] = WIRE_MSG_ACK;
+    return WIRE_ACK_SIZE;
+}
+
+esp_err_t wire_decode_display(const uint8_t *buf, size_t len, display_update_t *out)
+{
+    if (buf == NULL || out == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(out, 0, sizeof(*out));
+
+    if (len < 4 + LCD_ROWS)
+        return ESP_ERR_INVALID_SIZE;
+    if (buf[0] != WIRE_VERSION || buf[1] != WIRE_MSG_DISPLAY)
+        return ESP_ERR_INVALID_VERSION;
+
+    out->has_text = (buf[2] & WIRE_DISPLAY_HAS_TEXT) != 0;
+    out->has_buttons = (buf[2] & WIRE_DISPLAY_HAS_BUTTONS) != 0;
+    out->button_mask = buf[3];
+
+    size_t pos = 4;
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        if (pos >= len)
+            return ESP_ERR_INVALID_SIZE;
+
+        size_t row_len = buf[pos++];
+        if (pos + row_len > len)
+            return ESP_ERR_INVALID_SIZE;
+
+        // Rows longer than the LCD are accepted but truncated
+        size_t copy = row_len < LCD_COLS ? row_len : LCD_COLS;
+        memcpy(out->frame.lines[row], &buf[pos], copy);
+        out->frame.lines[row][copy] = '\0';
+        pos += row_len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t wire_decode_button_ack(const uint8_t *buf, size_t len, uint32_t *session_out, uint32_t *seq_out)
+{
+    if (buf == NULL || session_out == NULL || seq_out == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    if (len < WIRE_BUTTON_ACK_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+    if (buf[0] != WIRE_VERSION || buf[1] != WIRE_MSG_BUTTON_ACK)
+        return ESP_ERR_INVALID_VERSION;
+
+    *session_out = get_le32(&buf[4]);
+    *seq_out = get_le32(&buf[8]);
+    return ESP_OK;
+}
@@ -0,0 +1,344 @@
+// Host benchmark and differential fuzzer: display_parse() vs. the cJSON code
+// it replaced.
+//
+// The benchmark times each display payload through cJSON (parse, look up the
+// display fields, delete) and through display_parse(), and counts heap
+// allocations. The fuzzer mutates a seed corpus and checks that whenever both
+// parsers accept an input they produce the same frame and button mask. Inputs
+// only one side accepts are counted and the first of each kind is printed; the
+// README lists the known cases. Build against the cJSON that ships with ESP-IDF:
+//
+//     cc -O2 -c $IDF_PATH/components/json/cJSON/cJSON.c -o /tmp/cJSON.o
+//     c++ -O2 -std=c++17 -Iinclude -Itools/host -I$IDF_PATH/components/json/cJSON tools/display_parser_bench.cpp src/display_parser.cpp /tmp/cJSON.o -o /tmp/display_parser_bench
+//     /tmp/display_parser_bench [fuzz iterations] [seed]
+//
+// or against a system libcjson: -I/usr/include/cjson ... -lcjson
+#include "display_parser.h"
+#include "cJSON.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const int ITERATIONS = 200000;
+
+static const struct
+{
+    const char *name;
+    const char *json;
+} PAYLOADS[] = {
+    {"lines", "{\"line1\":\"Player 2 rolled\",\"line2\":\"Move 5 spaces\"}"},
+    {"lines+btns", "{\"line1\":\"Player 2 rolled\",\"line2\":\"Move 5 spaces\",\"buttons\":[1,2,3]}"},
+    {"message", "{\"message\":\"Waiting...\"}"},
+    {"buttons", "{\"buttons\":[2]}"},
+    {"extra keys", "{\"id\":42,\"meta\":{\"round\":3,\"tags\":[\"a\",\"b\"]},\"line1\":\"Round 3\",\"line2\":\"Go!\"}"},
+    {"escapes", "{\"line1\":\"\\\"Quoted\\\" \\u0041\\u00e9\",\"line2\":\"tab\\there\"}"},
+};
+
+// Inputs the old code handled differently, plus the payloads above
+static const char *const CORPUS[] = {
+    "{\"LINE1\":\"upper\",\"Line2\":\"mixed\"}",
+    "{\"Message\":\"one\",\"msg\":\"two\"}",
+    "{\"message\":7,\"MSG\":\"fallback\"}",
+    "{\"line1\":\"first\",\"Line1\":\"second\"}",
+    "{\"buttons\":1,\"Buttons\":[1,2]}",
+    "{\"buttons\":[1e0,0.2e1,30e-1,3.9,-1,4,1e99,-1e99,2147483648]}",
+    "{\"buttons\":[0.1e1,10e-1,100e-2,1.0e+0,2E0]}",
+    "{\"line1\":\"a\\u0000b\",\"line2\":\"\\ud83d\\ude00!\"}",
+    "{\"line1\":\"\\udc00\"}",
+    "{\"line1\":\"\\ud800x\"}",
+    "{\"line\\u0031\":\"escaped key\"}",
+    "{\"line1\":\"a string longer than sixteen columns\"}",
+    "{\"line1\":null,\"line2\":[\"x\"]}",
+    "[1,2,3]",
+    "\"just a string\"",
+    "{\"a\":{\"b\":{\"c\":{\"d\":[[[[1]]]]}}},\"buttons\":[3]}",
+    "{\"line1\":\"ok\"} trailing",
+};
+
+// Fragments spliced in by the fuzzer
+static const char *const TOKENS[] = {
+    "\"line1\"", "\"LINE2\"", "\"Message\"", "\"msg\"", "\"buttons\"", "\"Buttons\"",
+    "1e0", "0.2e1", "30e-1", "-0", "1E+0", "2147483648", "1e99", "0.5",
+    "\\u0000", "\\ud83d\\ude00", "\\udc00", "\\u00e9", "\\u0031", "\\\"",
+    "{", "}", "[", "]", ",", ":", "\"", "true", "null", "[1,2,3]",
+};
+
+typedef struct
+{
+    bool ok;
+    display_update_t update;
+} result_t;
+
+static size_t s_heap_allocs = 0;
+
+static void *counting_malloc(size_t size)
+{
+    s_heap_allocs++;
+    return malloc(size);
+}
+
+/**
+ * Copy a cJSON string the way the firmware shows it: a code point outside
+ * ASCII becomes one '?', and the row is cut at LCD_COLS.
+ * Fuzz inputs are ASCII, so any byte >= 0x80 came from a \u escape.
+ */
+static void copy_row(char *dst, const char *src)
+{
+    size_t n = 0;
+    for (const unsigned char *s = (const unsigned char *)src; *s != '\0' && n < LCD_COLS; s++)
+    {
+        if ((*s & 0xC0) == 0x80)
+            continue;
+        dst[n++] = *s < 0x80 ? (char)*s : '?';
+    }
+    dst[n] = '\0';
+}
+
+/**
+ * The handle_display_message logic from before display_parser existed
+ */
+static result_t parse_cjson(const char *json, size_t len)
+{
+    result_t r = {};
+    cJSON *root = cJSON_ParseWithLength(json, len);
+    if (root == NULL)
+        return r;
+    r.ok = true;
+
+    cJSON *line1_item = cJSON_GetObjectItem(root, "line1");
+    cJSON *line2_item = cJSON_GetObjectItem(root, "line2");
+
+    if (line1_item || line2_item)
+    {
+        r.update.has_text = true;
+        copy_row(r.update.frame.lines[0], (line1_item && cJSON_IsString(line1_item)) ? line1_item->valuestring : "");
+        copy_row(r.update.frame.lines[1], (line2_item && cJSON_IsString(line2_item)) ? line2_item->valuestring : "");
+    }
+    else
+    {
+        cJSON *msg_item = cJSON_GetObjectItem(root, "message");
+        if (!msg_item || !cJSON_IsString(msg_item))
+            msg_item = cJSON_GetObjectItem(root, "msg");
+        if (msg_item && cJSON_IsString(msg_item))
+        {
+            r.update.has_text = true;
+            copy_row(r.update.frame.lines[0], msg_item->valuestring);
+        }
+    }
+
+    cJSON *btns_item = cJSON_GetObjectItem(root, "buttons");
+    if (btns_item && cJSON_IsArray(btns_item))
+    {
+        r.update.has_buttons = true;
+        int count = cJSON_GetArraySize(btns_item);
+        for (int i = 0; i < count; i++)
+        {
+            cJSON *btn = cJSON_GetArrayItem(btns_item, i);
+            if (btn && cJSON_IsNumber(btn) && btn->valueint >= 1 && btn->valueint <= 3)
+                r.update.button_mask |= (uint8_t)(1 << (btn->valueint - 1));
+        }
+    }
+
+    cJSON_Delete(root);
+    return r;
+}
+
+static result_t parse_scanner(const char *json, size_t len)
+{
+    result_t r = {};
+    r.ok = display_parse(json, len, &r.update) == ESP_OK;
+    return r;
+}
+
+static bool same_update(const display_update_t *a, const display_update_t *b)
+{
+    if (a->has_text != b->has_text || a->has_buttons != b->has_buttons)
+        return false;
+    if (a->has_buttons && a->button_mask != b->button_mask)
+        return false;
+    if (!a->has_text)
+        return true;
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        if (strcmp(a->frame.lines[row], b->frame.lines[row]) != 0)
+            return false;
+    }
+    return true;
+}
+
+static void print_input(const char *label, const std::string &input)
+{
+    printf("  %s: ", label);
+    for (unsigned char c : input)
+    {
+        if (c >= 0x20 && c < 0x7F)
+            putchar(c);
+        else
+            printf("\\x%02x", c);
+    }
+    putchar('\n');
+}
+
+static void print_update(const char *label, const result_t *r)
+{
+    if (!r->ok)
+    {
+        printf("  %s: rejected\n", label);
+        return;
+    }
+    printf("  %s: text=%d [%s] [%s] buttons=%d mask=0x%02x\n", label, r->update.has_text,
+           r->update.frame.lines[0], r->update.frame.lines[1], r->update.has_buttons, r->update.button_mask);
+}
+
+static uint32_t s_rng = 1;
+
+static uint32_t next_random(void)
+{
+    // xorshift32
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static void mutate(std::string &s)
+{
+    static const char ALPHABET[] = " \t\n\r\"\\/{}[]:,.+-eE0123456789abfnrtuxyzLIMSGBN";
+    int edits = 1 + next_random() % 4;
+    for (int i = 0; i < edits; i++)
+    {
+        size_t at = s.empty() ? 0 : next_random() % (s.size() + 1);
+        switch (next_random() % 5)
+        {
+        case 0:
+            if (!s.empty() && at < s.size())
+                s.erase(at, 1 + next_random() % 4);
+            break;
+        case 1:
+            if (at < s.size())
+                s[at] = ALPHABET[next_random() % (sizeof(ALPHABET) - 1)];
+            break;
+        case 2:
+            s.insert(at, 1, ALPHABET[next_random() % (sizeof(ALPHABET) - 1)]);
+            break;
+        case 3:
+            s.insert(at, 1, (char)(0x20 + next_random() % 0x5F));
+            break;
+        default:
+            s.insert(at, TOKENS[next_random() % (sizeof(TOKENS) / sizeof(TOKENS[0]))]);
+            break;
+        }
+    }
+}
+
+static void benchmark(void)
+{
+    cJSON_Hooks hooks = {};
+    hooks.malloc_fn = counting_malloc;
+    hooks.free_fn = free;
+    cJSON_InitHooks(&hooks);
+
+    printf("%-11s %5s | %12s %9s | %10s %7s\n", "payload", "bytes", "cJSON allocs", "cJSON ns", "scanner ns",
+           "speedup");
+
+    for (const auto &payload : PAYLOADS)
+    {
+        size_t len = strlen(payload.json);
+        double ns[2];
+        double allocs = 0;
+        for (int side = 0; side < 2; side++)
+        {
+            s_heap_allocs = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < ITERATIONS; i++)
+            {
+                result_t r = side == 0 ? parse_cjson(payload.json, len) : parse_scanner(payload.json, len);
+                if (!r.ok)
+                {
+                    fprintf(stderr, "%s: parse failed\n", payload.name);
+                    exit(1);
+                }
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            ns[side] = std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+            if (side == 0)
+                allocs = (double)s_heap_allocs / ITERATIONS;
+        }
+        printf("%-11s %5zu | %12.1f %9.0f | %10.0f %6.2fx\n", payload.name, len,
+               allocs, ns[0], ns[1], ns[0] / ns[1]);
+    }
+}
+
+static int fuzz(long iterations)
+{
+    std::vector<std::string> seeds;
+    for (const auto &payload : PAYLOADS)
+        seeds.push_back(payload.json);
+    for (const char *json : CORPUS)
+        seeds.push_back(json);
+
+    long agree = 0;
+    long mismatched = 0;
+    long only_cjson = 0;
+    long only_scanner = 0;
+
+    for (long i = 0; i < iterations; i++)
+    {
+        // Every seed once as is, then mutated copies
+        bool is_seed = i < (long)seeds.size();
+        std::string input = seeds[is_seed ? i : next_random() % seeds.size()];
+        if (!is_seed)
+            mutate(input);
+
+        result_t want = parse_cjson(input.data(), input.size());
+        result_t got = parse_scanner(input.data(), input.size());
+
+        if (want.ok && got.ok)
+        {
+            if (same_update(&want.update, &got.update))
+            {
+                agree++;
+                continue;
+            }
+            if (mismatched++ < 10)
+            {
+                printf("MISMATCH\n");
+                print_input("input", input);
+                print_update("cJSON", &want);
+                print_update("scanner", &got);
+            }
+        }
+        else if (want.ok != got.ok)
+        {
+            long &count = want.ok ? only_cjson : only_scanner;
+            if (count++ == 0)
+            {
+                printf("first input only %s accepts\n", want.ok ? "cJSON" : "the scanner");
+                print_input("input", input);
+            }
+        }
+        else
+        {
+            agree++;
+        }
+    }
+
+    printf("\n%ld inputs: %ld agree, %ld mismatched, %ld accepted only by cJSON, %ld only by the scanner\n",
+           iterations, agree, mismatched, only_cjson, only_scanner);
+    return mismatched == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    s_rng = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x2545F491;
+    if (s_rng == 0)
+        s_rng = 1;
+
+    benchmark();
+    printf("\n");
+    return fuzz(iterations);
+}
@@ -0,0 +1,119 @@
+// Host benchmark: cJSON parse + delete with the heap vs. the message arena.
+//
+// Parses each payload the base receives, once with malloc/free hooks and once
+// with the BumpArena behind json_arena.cpp, and prints heap allocations and
+// time per message. Build against the cJSON that ships with ESP-IDF:
+//
+//     cc -O2 -c $IDF_PATH/components/json/cJSON/cJSON.c -o /tmp/cJSON.o
+//     c++ -O2 -std=c++17 -Iinclude -I$IDF_PATH/components/json/cJSON tools/json_arena_bench.cpp /tmp/cJSON.o -o /tmp/json_arena_bench
+//     /tmp/json_arena_bench
+//
+// or against a system libcjson: -I/usr/include/cjson ... -lcjson
+#include "bump_arena.h"
+#include "json_arena.h"
+#include "cJSON.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int ITERATIONS = 200000;
+
+static const struct
+{
+    const char *name;
+    const char *json;
+} PAYLOADS[] = {
+    {"display", "{\"line1\":\"Player 2 rolled\",\"line2\":\"Move 5 spaces\",\"buttons\":[1,2,3]}"},
+    {"cue", "{\"id\":7,\"cue\":\"SIGNAL\",\"at\":1760870000123456}"},
+    {"reaction", "{\"round\":3,\"timeout_ms\":3000,\"at\":1760870000123456}"},
+    {"pong", "{\"t0\":81234567,\"t1\":1760870000123456,\"t2\":1760870000123470}"},
+    {"button_ack", "{\"session\":3735928559,\"seq\":41}"},
+    {"caps", "{\"binary\":[\"button\",\"ack\",\"display\"],\"acks\":true}"},
+};
+
+static size_t s_heap_allocs = 0;
+
+alignas(BumpArena::ALIGN) static uint8_t s_buffer[JSON_ARENA_SIZE];
+static BumpArena s_arena(s_buffer, sizeof(s_buffer));
+
+static void *heap_malloc(size_t size)
+{
+    s_heap_allocs++;
+    return malloc(size);
+}
+
+static void *arena_malloc(size_t size)
+{
+    void *block = s_arena.alloc(size);
+    if (block != NULL)
+        return block;
+    s_heap_allocs++;
+    return malloc(size);
+}
+
+static void arena_free(void *ptr)
+{
+    if (!s_arena.owns(ptr))
+        free(ptr);
+}
+
+typedef struct
+{
+    double allocs; // Heap allocations per message
+    double ns;     // Parse + delete time per message
+    size_t bytes;  // Arena bytes one message needs
+} result_t;
+
+static bool run(const char *json, bool use_arena, result_t *out)
+{
+    cJSON_Hooks hooks = {};
+    hooks.malloc_fn = use_arena ? arena_malloc : heap_malloc;
+    hooks.free_fn = use_arena ? arena_free : free;
+    cJSON_InitHooks(&hooks);
+
+    size_t len = strlen(json);
+    out->bytes = 0;
+    s_heap_allocs = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        cJSON *root = cJSON_ParseWithLength(json, len);
+        if (root == NULL)
+            return false;
+        cJSON_Delete(root);
+        if (use_arena)
+        {
+            if (s_arena.used() > out->bytes)
+                out->bytes = s_arena.used();
+            s_arena.reset();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    out->allocs = (double)s_heap_allocs / ITERATIONS;
+    out->ns = std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+    return true;
+}
+
+int main(void)
+{
+    printf("%-11s %5s | %12s %9s | %12s %9s %11s | %7s\n",
+           "payload", "bytes", "heap allocs", "heap ns", "arena allocs", "arena ns", "arena bytes", "speedup");
+
+    for (const auto &payload : PAYLOADS)
+    {
+        result_t heap, arena;
+        if (!run(payload.json, false, &heap) || !run(payload.json, true, &arena))
+        {
+            fprintf(stderr, "%s: parse failed\n", payload.name);
+            return 1;
+        }
+        printf("%-11s %5zu | %12.1f %9.0f | %12.1f %9.0f %11zu | %6.2fx\n",
+               payload.name, strlen(payload.json), heap.allocs, heap.ns, arena.allocs, arena.ns,
+               arena.bytes, heap.ns / arena.ns);
+    }
+
+    printf("\narena: %d B, high-water %zu B\n", JSON_ARENA_SIZE, s_arena.high_water());
+    return 0;
+}
@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""Sit between a base and the broker and measure MQTT bytes and latency.
+
+Point MQTT_BROKER_URL at this proxy, run it next to the real broker, and
+drive some traffic: press buttons, and send display messages with
+tools/payload_sizes.py (each one is acked). Do it once with the 3.1.1 build
+and once with CONFIG_MQTT_PROTOCOL_5=y, then compare the two reports:
+
+    python3 tools/mqtt_wire_stats.py --broker localhost --listen-port 1884
+    python3 tools/payload_sizes.py --port 1883 --base <id> --sizes 64 --repeat 200
+
+For every PUBLISH in each direction the proxy records the full packet size,
+so topic aliases and user properties show up as they go over the wire. Aliased
+topics are resolved back to names. It also times each game/<id>/display it
+passes to the base until the base's game/<id>/ack comes back, which leaves
+out the broker and the far client. A report is printed every --interval
+seconds and on Ctrl-C. Needs only the standard library.
+"""
+import argparse
+import asyncio
+import collections
+import statistics
+import struct
+import time
+
+CONNECT = 1
+PUBLISH = 3
+
+# MQTT 5 property identifier -> value encoding, for skipping properties
+PROPERTY_TYPES = {
+    0x01: "byte", 0x02: "u32", 0x03: "str", 0x08: "str", 0x09: "bin", 0x0B: "varint",
+    0x11: "u32", 0x12: "str", 0x13: "u16", 0x15: "str", 0x16: "bin", 0x17: "byte",
+    0x18: "u32", 0x19: "byte", 0x1A: "str", 0x1C: "str", 0x1F: "str", 0x21: "u16",
+    0x22: "u16", 0x23: "u16", 0x24: "byte", 0x25: "byte", 0x26: "pair", 0x27: "u32",
+    0x28: "byte", 0x29: "byte", 0x2A: "byte",
+}
+TOPIC_ALIAS = 0x23
+STALE_DISPLAY_S = 2.0
+
+
+class Stats:
+    def __init__(self):
+        self.sizes = collections.defaultdict(list)  # (direction, topic) -> packet sizes
+        self.totals = collections.Counter()  # direction -> bytes
+        self.turnaround_ms = []
+
+    def report(self):
+        print(f"\n{'dir':<3} {'topic':<32} {'count':>6} {'min':>5} {'avg':>7} {'max':>5}")
+        for (direction, topic), sizes in sorted(self.sizes.items()):
+            print(f"{direction:<3} {topic:<32} {len(sizes):>6} {min(sizes):>5} "
+                  f"{statistics.mean(sizes):>7.1f} {max(sizes):>5}")
+        print(f"bytes up {self.totals['up']}, down {self.totals['dn']}")
+        if self.turnaround_ms:
+            t = sorted(self.turnaround_ms)
+            print(f"display -> ack at the proxy: n={len(t)} min {t[0]:.1f} ms, "
+                  f"median {t[len(t) // 2]:.1f} ms, p95 {t[int(len(t) * 0.95)]:.1f} ms, max {t[-1]:.1f} ms")
+
+
+def read_varint(data, pos):
+    value = 0
+    for shift in range(0, 28, 7):
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, pos
+    raise ValueError("malformed variable byte integer")
+
+
+def skip_properties(data, pos, end):
+    """Return the topic alias, if any, from the properties in data[pos:end]."""
+    alias = None
+    while pos < end:
+        prop, pos = read_varint(data, pos)
+        kind = PROPERTY_TYPES.get(prop)
+        if kind == "byte":
+            pos += 1
+        elif kind == "u16":
+            if prop == TOPIC_ALIAS:
+                alias = struct.unpack_from(">H", data, pos)[0]
+            pos += 2
+        elif kind == "u32":
+            pos += 4
+        elif kind == "varint":
+            _, pos = read_varint(data, pos)
+        elif kind in ("str", "bin"):
+            pos += 2 + struct.unpack_from(">H", data, pos)[0]
+        elif kind == "pair":
+            pos += 2 + struct.unpack_from(">H", data, pos)[0]
+            pos += 2 + struct.unpack_from(">H", data, pos)[0]
+        else:
+            raise ValueError(f"unknown property 0x{prop:02x}")
+    return alias
+
+
+class Connection:
+    """One base connection; packets are parsed as they are forwarded."""
+
+    def __init__(self, stats):
+        self.stats = stats
+        self.version = 4
+        self.aliases = {"up": {}, "dn": {}}
+        self.pending_display = collections.deque()
+
+    def on_packet(self, direction, packet, header_len):
+        kind = packet[0] >> 4
+        if kind == CONNECT:
+            name_len = struct.unpack_from(">H", packet, header_len)[0]
+            self.version = packet[header_len + 2 + name_len]
+        elif kind == PUBLISH:
+            self.on_publish(direction, packet, header_len)
+
+    def on_publish(self, direction, packet, pos):
+        qos = (packet[0] >> 1) & 3
+        topic_len = struct.unpack_from(">H", packet, pos)[0]
+        topic = packet[pos + 2:pos + 2 + topic_len].decode(errors="replace")
+        pos += 2 + topic_len + (2 if qos else 0)
+        if self.version == 5:
+            props_len, pos = read_varint(packet, pos)
+            alias = skip_properties(packet, pos, pos + props_len)
+            if alias is not None:
+                if topic:
+                    self.aliases[direction][alias] = topic
+                else:
+                    topic = self.aliases[direction].get(alias, f"<alias {alias}>")
+
+        self.stats.sizes[(direction, topic)].append(len(packet))
+        now = time.perf_counter()
+        if direction == "dn" and topic.endswith("/display"):
+            self.pending_display.append(now)
+        elif direction == "up" and topic.endswith("/ack"):
+            # A display the base dropped never gets an ack
+            while self.pending_display and now - self.pending_display[0] > STALE_DISPLAY_S:
+                self.pending_display.popleft()
+            if self.pending_display:
+                self.stats.turnaround_ms.append((now - self.pending_display.popleft()) * 1000)
+
+
+async def pump(reader, writer, direction, conn):
+    buffer = bytearray()
+    while True:
+        chunk = await reader.read(65536)
+        if not chunk:
+            break
+        writer.write(chunk)
+        conn.stats.totals[direction] += len(chunk)
+        buffer += chunk
+        # Parse every complete packet in the buffer
+        while len(buffer) >= 2:
+            try:
+                remaining, header_len = read_varint(buffer, 1)
+            except IndexError:
+                break
+            size = header_len + remaining
+            if len(buffer) < size:
+                break
+            try:
+                conn.on_packet(direction, bytes(buffer[:size]), header_len)
+            except (ValueError, IndexError, struct.error) as err:
+                print(f"{direction}: unparsed packet: {err}")
+            del buffer[:size]
+        await writer.drain()
+    writer.close()
+
+
+async def serve(args, stats):
+    async def on_client(client_reader, client_writer):
+        peer = client_writer.get_extra_info("peername")
+        print(f"{time.strftime('%H:%M:%S')} base connected from {peer[0]}")
+        try:
+            broker_reader, broker_writer = await asyncio.open_connection(args.broker, args.port)
+        except OSError as err:
+            print(f"cannot reach the broker: {err}")
+            client_writer.close()
+            return
+        conn = Connection(stats)
+        try:
+            await asyncio.gather(pump(client_reader, broker_writer, "up", conn),
+                                 pump(broker_reader, client_writer, "dn", conn),
+                                 return_exceptions=True)
+        except asyncio.CancelledError:
+            return
+        print(f"{time.strftime('%H:%M:%S')} base disconnected (MQTT {'5' if conn.version == 5 else '3.1.1'})")
+
+    server = await asyncio.start_server(on_client, args.listen, args.listen_port)
+    async with server:
+        while True:
+            await asyncio.sleep(args.interval)
+            stats.report()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--listen", default="0.0.0.0")
+    parser.add_argument("--listen-port", type=int, default=1884)
+    parser.add_argument("--interval", type=float, default=30.0)
+    args = parser.parse_args()
+
+    stats = Stats()
+    try:
+        asyncio.run(serve(args, stats))
+    except KeyboardInterrupt:
+        stats.report()
+
+
+if __name__ == "__main__":
+    main()
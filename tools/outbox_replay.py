@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Stop and restart the broker mid-game and check the outbox replay.
+
+Keep pressing buttons on the base while this runs. After --stop-after
+seconds the broker is stopped with --stop-cmd, and after --down seconds it is
+started again with --start-cmd. Presses made while it was down should arrive
+after the restart, in seq order, with no gaps and their original timestamps:
+
+    python3 tools/outbox_replay.py --broker 192.168.1.10 --base <id> \\
+        --stop-cmd "docker stop mosquitto" --start-cmd "docker start mosquitto"
+
+Without the two commands, stop and start the broker by hand while it runs;
+the outage is then timed from when this script loses the broker.
+Run tools/pong_echo.py too if timestamps should be checked; without clock
+sync the base stamps presses with time since boot. With --acks the script
+also answers base/<id>/caps with "acks":true and acks every event on
+game/<id>/button_ack, so in-flight resends are exercised as well.
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+import argparse
+import collections
+import json
+import shlex
+import struct
+import subprocess
+import sys
+import time
+
+import paho.mqtt.client as mqtt
+
+WIRE_VERSION = 2
+WIRE_MSG_BUTTON = 1
+BUTTON_FRAME = struct.Struct("<BBBBIIq")  # wire_format.h WIRE_MSG_BUTTON
+WIRE_ERR_UNSYNCED = 0xFF
+
+
+def decode_button(payload):
+    """Return (session, seq, timestamp_ms, synced) from a JSON or binary event."""
+    if len(payload) == BUTTON_FRAME.size and payload[0] == WIRE_VERSION and payload[1] == WIRE_MSG_BUTTON:
+        _, _, _, err, session, seq, timestamp = BUTTON_FRAME.unpack(payload)
+        return session, seq, timestamp, err != WIRE_ERR_UNSYNCED
+    event = json.loads(payload)
+    return event["session"], event["seq"], event["timestamp"], event.get("err", -1) >= 0
+
+
+def make_client():
+    if hasattr(mqtt, "CallbackAPIVersion"):
+        return mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    return mqtt.Client()
+
+
+def report(events, down_at, up_at):
+    failures = 0
+    by_session = collections.defaultdict(list)
+    for event in events:
+        by_session[event["session"]].append(event)
+
+    for session, received in by_session.items():
+        seqs = [e["seq"] for e in received]
+        unique = sorted(set(seqs))
+        missing = sorted(set(range(unique[0], unique[-1] + 1)) - set(unique))
+        # A resend repeats a seq; a new seq below one already seen is out of order
+        seen = set()
+        out_of_order = 0
+        for seq in seqs:
+            if seq not in seen and seen and seq < max(seen):
+                out_of_order += 1
+            seen.add(seq)
+        duplicates = len(seqs) - len(unique)
+        print(f"session {session}: {len(seqs)} events, seq {unique[0]}..{unique[-1]}, "
+              f"{len(missing)} missing, {out_of_order} out of order, {duplicates} resent")
+        if missing:
+            print(f"  missing seq: {missing[:20]}{' ...' if len(missing) > 20 else ''}")
+        failures += bool(missing) + bool(out_of_order)
+
+        if down_at is None or up_at is None:
+            continue
+        # Presses captured while the broker was down, delivered after it came back
+        replayed = [e for e in received if e["rx"] >= up_at and e["synced"] and e["timestamp"] / 1000 < up_at]
+        if replayed:
+            ages = [e["rx"] - e["timestamp"] / 1000 for e in replayed]
+            kept = sum(1 for e in replayed if down_at - 1 <= e["timestamp"] / 1000 <= up_at)
+            print(f"  {len(replayed)} replayed after the restart, {kept} stamped inside the outage, "
+                  f"delivered {min(ages):.2f}-{max(ages):.2f} s after capture")
+        elif not any(e["synced"] for e in received):
+            print("  timestamps are time since boot; run tools/pong_echo.py to check them")
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--base", default="+", help="base ID, default: every base")
+    parser.add_argument("--stop-cmd", help="shell command that stops the broker")
+    parser.add_argument("--start-cmd", help="shell command that starts it again")
+    parser.add_argument("--stop-after", type=float, default=20.0, help="seconds before stopping the broker")
+    parser.add_argument("--down", type=float, default=15.0, help="seconds the broker stays down")
+    parser.add_argument("--duration", type=float, default=60.0, help="total seconds to run")
+    parser.add_argument("--acks", action="store_true", help="enable and send button acks")
+    args = parser.parse_args()
+
+    events = []
+    highest = {}  # (base, session) -> highest seq seen
+    outage = {"down": None, "up": None}  # When the broker went away and came back
+
+    def on_connect(client, *_):
+        client.subscribe([(f"base/{args.base}/button", 0), (f"base/{args.base}/caps", 1)])
+        print(f"{time.strftime('%H:%M:%S')} connected to the broker")
+        if outage["down"] is not None and outage["up"] is None:
+            outage["up"] = time.time()
+
+    def on_message(client, userdata, msg):
+        rx = time.time()
+        base = msg.topic.split("/")[1]
+        if msg.topic.endswith("/caps"):
+            if args.acks:
+                client.publish(f"game/{base}/caps", json.dumps({"binary": [], "acks": True}), qos=1)
+            return
+        try:
+            session, seq, timestamp, synced = decode_button(msg.payload)
+        except (ValueError, KeyError, TypeError, struct.error):
+            print(f"undecodable event on {msg.topic}: {msg.payload!r}", file=sys.stderr)
+            return
+        events.append({"session": session, "seq": seq, "timestamp": timestamp, "synced": synced, "rx": rx})
+        key = (base, session)
+        highest[key] = max(seq, highest.get(key, seq))
+        if args.acks:
+            ack = {"session": session, "seq": highest[key]}
+            client.publish(f"game/{base}/button_ack", json.dumps(ack), qos=0)
+
+    client = make_client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+
+    # Drive the client loop here and reconnect as soon as the broker is back,
+    # so the replay is not missed while paho waits out its backoff
+    start = time.time()
+    stopping = starting = None
+    stopped_at = 0.0
+    last_attempt = 0.0
+    while time.time() - start < args.duration:
+        now = time.time()
+        if args.stop_cmd and stopping is None and now - start >= args.stop_after:
+            print(f"{time.strftime('%H:%M:%S')} stopping the broker")
+            stopping = subprocess.Popen(shlex.split(args.stop_cmd))
+            stopped_at = now
+        if stopping is not None and stopping.poll() is not None and args.start_cmd and starting is None \
+                and now - stopped_at >= args.down:
+            print(f"{time.strftime('%H:%M:%S')} starting the broker")
+            starting = subprocess.Popen(shlex.split(args.start_cmd))
+
+        if client.loop(timeout=0.05) == mqtt.MQTT_ERR_SUCCESS:
+            continue
+        if outage["down"] is None:
+            outage["down"] = now
+            print(f"{time.strftime('%H:%M:%S')} lost the broker")
+        if now - last_attempt >= 0.1:
+            last_attempt = now
+            try:
+                client.reconnect()
+            except OSError:
+                pass
+        time.sleep(0.01)
+
+    if starting is not None:
+        starting.wait()
+    client.disconnect()
+
+    if not events:
+        print("no button events received", file=sys.stderr)
+        sys.exit(1)
+    sys.exit(1 if report(events, outage["down"], outage["up"]) else 0)
+
+
+if __name__ == "__main__":
+    main()
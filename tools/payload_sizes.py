@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Send display messages from 1 B to 8 KB and check that each one is acked.
+
+Payloads above the client's 1 KB buffer arrive in fragments and are
+reassembled by mqtt_manager. Anything above MQTT_RX_BUFFER_SIZE (8 KB) is
+dropped and counted as "rx_dropped" in telemetry, so it gets no ack. Run
+against a local broker with the base connected:
+
+    python3 tools/payload_sizes.py --broker 192.168.1.10 --base <id>
+
+Every size is sent --repeat times at QoS 1 and the time to the game/<id>/ack
+is reported. Telemetry is requested before and after, and the change in
+rx_dropped is printed. Requires paho-mqtt (pip install paho-mqtt).
+"""
+import argparse
+import json
+import queue
+import sys
+import time
+
+import paho.mqtt.client as mqtt
+
+RX_BUFFER_SIZE = 8192  # MQTT_RX_BUFFER_SIZE in include/mqtt_manager.h
+SIZES = [1, 2, 16, 64, 255, 256, 1023, 1024, 1025, 2048, 4096, 8191, 8192, 8193]
+
+
+def make_payload(size):
+    """Valid JSON of exactly size bytes; line1 shows the size where it fits."""
+    text = f'{{"line1":"{size} B","pad":"'
+    if size < len(text) + 2:
+        # A bare number or {} is still a valid display message with no fields
+        return b"{}" if size == 2 else b"1" * size
+    return (text + "x" * (size - len(text) - 2) + '"}').encode()
+
+
+def make_client():
+    if hasattr(mqtt, "CallbackAPIVersion"):
+        return mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    return mqtt.Client()
+
+
+def request_telemetry(client, base, telemetry, timeout):
+    while not telemetry.empty():
+        telemetry.get_nowait()
+    client.publish(f"game/{base}/telemetry", json.dumps({"now": True}), qos=1)
+    try:
+        return telemetry.get(timeout=timeout)
+    except queue.Empty:
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--base", required=True, help="base ID, as in base/<id>/...")
+    parser.add_argument("--repeat", type=int, default=5)
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for each ack")
+    parser.add_argument("--sizes", type=lambda s: [int(x) for x in s.split(",")], default=SIZES)
+    args = parser.parse_args()
+
+    acks = queue.Queue()
+    telemetry = queue.Queue()
+
+    def on_message(client, userdata, msg):
+        if msg.topic.endswith("/ack"):
+            acks.put(time.perf_counter())
+        elif msg.topic.endswith("/telemetry"):
+            try:
+                telemetry.put(json.loads(msg.payload))
+            except ValueError:
+                pass
+
+    client = make_client()
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.subscribe([(f"game/{args.base}/ack", 1), (f"base/{args.base}/telemetry", 0)])
+    client.loop_start()
+    time.sleep(0.5)
+
+    before = request_telemetry(client, args.base, telemetry, 5)
+    failures = 0
+    print(f"{'size':>6} {'acked':>7} {'min ms':>8} {'avg ms':>8} {'max ms':>8}  expected")
+    for size in args.sizes:
+        payload = make_payload(size)
+        expect_ack = size <= RX_BUFFER_SIZE
+        times = []
+        for _ in range(args.repeat):
+            while not acks.empty():
+                acks.get_nowait()
+            start = time.perf_counter()
+            client.publish(f"game/{args.base}/display", payload, qos=1)
+            try:
+                times.append((acks.get(timeout=args.timeout) - start) * 1000)
+            except queue.Empty:
+                pass
+        ok = len(times) == args.repeat if expect_ack else not times
+        failures += not ok
+        stats = f"{min(times):8.1f} {sum(times) / len(times):8.1f} {max(times):8.1f}" if times else f"{'-':>8} " * 3
+        print(f"{size:>6} {len(times):>3}/{args.repeat:<3} {stats}  {'ack' if expect_ack else 'drop'}"
+              f"{'' if ok else '  FAIL'}")
+
+    after = request_telemetry(client, args.base, telemetry, 5)
+    client.loop_stop()
+
+    if before and after:
+        print(f"rx_dropped {before.get('rx_dropped')} -> {after.get('rx_dropped')}, "
+              f"rx_pending {after.get('rx_pending')}")
+    else:
+        print("no telemetry reply; is the base connected?", file=sys.stderr)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+"""Answer clock sync pings so RTT can be measured without the game server.
+
+Run next to a local broker, pin a profile on each base and read the telemetry:
+
+    python3 tools/pong_echo.py --broker 192.168.1.10
+    mosquitto_pub -t game/<id>/wifi_profile -m LOW_LATENCY
+    mosquitto_sub -t base/+/telemetry      # "ps" and "rtt_us":[min,avg,max]
+
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+import argparse
+import json
+import time
+
+import paho.mqtt.client as mqtt
+
+
+def now_us():
+    return time.time_ns() // 1000
+
+
+def on_message(client, userdata, msg):
+    t1 = now_us()
+    try:
+        t0 = json.loads(msg.payload)["t0"]
+    except (ValueError, KeyError, TypeError):
+        return
+    # base/<id>/time/ping -> game/<id>/time/pong
+    base_id = msg.topic.split("/")[1]
+    pong = {"t0": t0, "t1": t1, "t2": now_us()}
+    client.publish(f"game/{base_id}/time/pong", json.dumps(pong), qos=0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    args = parser.parse_args()
+
+    if hasattr(mqtt, "CallbackAPIVersion"):
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    else:
+        client = mqtt.Client()
+    client.on_connect = lambda c, *_: c.subscribe("base/+/time/ping", qos=0)
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.loop_forever()
+
+
+if __name__ == "__main__":
+    main()
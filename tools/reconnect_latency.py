@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Knock a base off the broker and time how fast it is back in service.
+
+The base is disconnected by a session takeover: this script connects briefly
+with the base's own client ID (base-<id>, clean_session false, so a persistent
+session survives) and the broker drops the base. A display message is then
+published at QoS 1 while the base is away. Per round it reports:
+
+- connect: takeover to the base's CONNECTED on game/<id>/connection
+- first:   takeover to the ack of the first display message handled
+- queued:  whether the display sent while the base was away arrived
+
+Run it against the same broker with MQTT_PERSISTENT_SESSION 0 and 1 in
+include/mqtt_manager.h to compare before and after. Without a persistent
+session the queued display is lost, so a second one is sent after CONNECTED:
+
+    python3 tools/reconnect_latency.py --broker 192.168.1.10 --base <id> --rounds 20
+
+The base logs its own view of each reconnect ("First message ... ms after
+disconnect"). Requires paho-mqtt (pip install paho-mqtt).
+"""
+import argparse
+import json
+import statistics
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+LIVE_RESEND_S = 1.0  # Wait after CONNECTED before giving up on the queued display
+
+
+def make_client(client_id="", clean_session=True):
+    if hasattr(mqtt, "CallbackAPIVersion"):
+        return mqtt.Client(mqtt.CallbackAPIVersion.VERSION2, client_id=client_id, clean_session=clean_session)
+    return mqtt.Client(client_id=client_id, clean_session=clean_session)
+
+
+def take_over(args):
+    """Connect as the base so the broker drops it; return when that has happened."""
+    connected = threading.Event()
+    client = make_client(f"base-{args.base}", clean_session=False)
+    client.on_connect = lambda *_: connected.set()
+    client.connect(args.broker, args.port)
+    client.loop_start()
+    if not connected.wait(5):
+        client.loop_stop()
+        raise RuntimeError("takeover connect timed out")
+    kicked = time.perf_counter()
+    client.disconnect()
+    client.loop_stop()
+    return kicked
+
+
+def summarize(name, values):
+    if not values:
+        return f"{name}: none"
+    return (f"{name}: n={len(values)} min {min(values):.0f} ms, median {statistics.median(values):.0f} ms, "
+            f"max {max(values):.0f} ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--broker", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--base", required=True, help="base ID, as in base/<id>/...")
+    parser.add_argument("--rounds", type=int, default=10)
+    parser.add_argument("--gap", type=float, default=3.0, help="seconds between rounds")
+    parser.add_argument("--timeout", type=float, default=15.0, help="seconds to wait for the base each round")
+    args = parser.parse_args()
+
+    lock = threading.Lock()
+    seen = {"connected": None, "ack": None}
+
+    def on_message(client, userdata, msg):
+        now = time.perf_counter()
+        if msg.retain:
+            return  # The retained CONNECTED from before this round
+        with lock:
+            if msg.topic.endswith("/connection") and msg.payload == b"CONNECTED" and seen["connected"] is None:
+                seen["connected"] = now
+            elif msg.topic.endswith("/ack") and seen["ack"] is None:
+                seen["ack"] = now
+
+    monitor = make_client()
+    monitor.on_message = on_message
+    monitor.connect(args.broker, args.port)
+    monitor.subscribe([(f"game/{args.base}/connection", 1), (f"game/{args.base}/ack", 1)])
+    monitor.loop_start()
+    time.sleep(0.5)
+
+    connect_ms, first_ms = [], []
+    queued_delivered = 0
+    display_topic = f"game/{args.base}/display"
+    for round_no in range(1, args.rounds + 1):
+        with lock:
+            seen["connected"] = seen["ack"] = None
+        kicked = take_over(args)
+        queued = json.dumps({"line1": "Reconnect test", "line2": f"Round {round_no} queued"})
+        monitor.publish(display_topic, queued, qos=1)
+
+        resent = False
+        connected = ack = None
+        deadline = kicked + args.timeout
+        while time.perf_counter() < deadline:
+            with lock:
+                connected, ack = seen["connected"], seen["ack"]
+            if ack is not None and connected is not None:
+                break
+            if connected is not None and ack is None and not resent and \
+                    time.perf_counter() - connected > LIVE_RESEND_S:
+                live = json.dumps({"line1": "Reconnect test", "line2": f"Round {round_no} live"})
+                monitor.publish(display_topic, live, qos=1)
+                resent = True
+            time.sleep(0.005)
+
+        if connected is None:
+            print(f"round {round_no}: base did not reconnect within {args.timeout:.0f} s")
+        else:
+            connect_ms.append((connected - kicked) * 1000)
+            line = f"round {round_no}: connect {connect_ms[-1]:.0f} ms"
+            if ack is not None:
+                first_ms.append((ack - kicked) * 1000)
+                queued_delivered += not resent
+                line += f", first {first_ms[-1]:.0f} ms, queued {'lost' if resent else 'delivered'}"
+            else:
+                line += ", no ack"
+            print(line)
+        time.sleep(args.gap)
+
+    monitor.loop_stop()
+    print()
+    print(summarize("connect", connect_ms))
+    print(summarize("first", first_ms))
+    print(f"queued display delivered in {queued_delivered}/{args.rounds} rounds")
+    sys.exit(0 if len(first_ms) == args.rounds else 1)
+
+
+if __name__ == "__main__":
+    main()
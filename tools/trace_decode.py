@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Turn a base's trace dump into Chrome trace JSON for ui.perfetto.dev.
+
+Capture a dump over MQTT (binary records) or from the serial log
+("TRACE:<hex>" lines), then decode it:
+
+    mosquitto_sub -t base/<id>/trace -N > trace.bin &
+    mosquitto_pub -t game/<id>/trace -m DUMP
+    python3 tools/trace_decode.py trace.bin -o trace.json
+
+    mosquitto_pub -t game/<id>/trace -m DUMP_UART
+    python3 tools/trace_decode.py monitor.log -o trace.json
+
+Event names come from the trace_event_t enum in include/trace.h.
+"""
+import argparse
+import json
+import pathlib
+import re
+import struct
+import sys
+
+RECORD = struct.Struct("<IHBBII")
+HEADER = pathlib.Path(__file__).resolve().parent.parent / "include" / "trace.h"
+HEX_LINE = re.compile(r"TRACE:([0-9a-fA-F]{%d})" % (2 * RECORD.size))
+
+
+def load_names(header):
+    names = {}
+    for name, value in re.findall(r"\bTRACE_(\w+) = (\d+),", header.read_text()):
+        names[int(value)] = name
+    return names
+
+
+def read_records(path):
+    data = path.read_bytes()
+    lines = HEX_LINE.findall(data.decode("ascii", errors="ignore"))
+    if lines:
+        data = b"".join(bytes.fromhex(line) for line in lines)
+    usable = len(data) - len(data) % RECORD.size
+    if usable != len(data):
+        print(f"{path}: ignoring {len(data) - usable} trailing bytes", file=sys.stderr)
+    return [RECORD.unpack_from(data, offset) for offset in range(0, usable, RECORD.size)]
+
+
+def to_events(records, names):
+    events = []
+    threads = {}  # tid -> track name
+    slice_tracks = {}  # slice name -> tid
+    open_slices = {}
+    base = 0
+    last = None
+
+    for time_us, event_id, core, isr, arg0, arg1 in records:
+        # Timestamps are the low 32 bits of esp_timer time. Records from the
+        # two cores can land a few us out of order, so only a big step back
+        # is a wrap.
+        if last is not None and time_us + (1 << 31) < last:
+            base += 1 << 32
+        last = time_us
+        ts = base + time_us
+        name = names.get(event_id, f"EVENT_{event_id}")
+        args = {"arg0": arg0, "arg1": arg1}
+
+        if name.endswith("_BEGIN"):
+            open_slices[(name[:-6], arg0)] = (ts, args)
+            continue
+        if name.endswith("_END"):
+            key = (name[:-4], arg0)
+            if key in open_slices:
+                start, begin_args = open_slices.pop(key)
+                slice_name = key[0]
+                tid = slice_tracks.setdefault(slice_name, 100 + len(slice_tracks))
+                threads[tid] = slice_name
+                events.append({"name": f"{slice_name} {arg0}", "ph": "X", "pid": 0, "tid": tid,
+                               "ts": start, "dur": ts - start, "args": {"begin": begin_args, "end": args}})
+                continue
+
+        tid = core * 2 + isr
+        threads[tid] = f"core {core}" + (" ISR" if isr else "")
+        events.append({"name": name, "ph": "i", "s": "t", "pid": 0, "tid": tid, "ts": ts, "args": args})
+
+    for tid, name in threads.items():
+        events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": tid, "args": {"name": name}})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", type=pathlib.Path, help="binary dump or serial log")
+    parser.add_argument("-o", "--output", type=pathlib.Path, help="default: stdout")
+    parser.add_argument("--header", type=pathlib.Path, default=HEADER)
+    args = parser.parse_args()
+
+    records = read_records(args.dump)
+    trace = {"traceEvents": to_events(records, load_names(args.header)), "displayTimeUnit": "ms"}
+    text = json.dumps(trace, indent=1)
+    if args.output:
+        args.output.write_text(text)
+        print(f"{len(records)} records -> {args.output}", file=sys.stderr)
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,208 @@
+// Host benchmark: JSON vs. binary wire format for the negotiated topics.
+//
+// Encodes or decodes each message the way mqtt_manager, main and
+// button_outbox do for either encoding, and prints payload bytes and time per
+// message. It also checks that both encodings of a display frame decode to
+// the same update. Build against the cJSON that ships with ESP-IDF:
+//
+//     cc -O2 -c $IDF_PATH/components/json/cJSON/cJSON.c -o /tmp/cJSON.o
+//     c++ -O2 -std=c++17 -Iinclude -Itools/host -I$IDF_PATH/components/json/cJSON tools/wire_format_bench.cpp src/wire_format.cpp src/display_parser.cpp /tmp/cJSON.o -o /tmp/wire_format_bench
+//     /tmp/wire_format_bench
+//
+// or against a system libcjson: -I/usr/include/cjson ... -lcjson
+#include "wire_format.h"
+#include "display_parser.h"
+#include "cJSON.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int ITERATIONS = 1000000;
+
+static const char *const PLAYER_ID = "player2";
+static const uint32_t SESSION = 3735928559u;
+static const int64_t TIMESTAMP_MS = 1760870000123;
+
+static const char DISPLAY_JSON[] = "{\"line1\":\"Player 2 rolled\",\"line2\":\"Move 5 spaces\",\"buttons\":[1,2,3]}";
+static const char BUTTON_ACK_JSON[] = "{\"session\":3735928559,\"seq\":41}";
+
+static uint8_t s_display_frame[64];
+static size_t s_display_frame_len = 0;
+static const uint8_t BUTTON_ACK_FRAME[WIRE_BUTTON_ACK_SIZE] = {WIRE_VERSION, WIRE_MSG_BUTTON_ACK, 0, 0, 0xEF, 0xBE, 0xAD, 0xDE, 41, 0, 0, 0};
+
+// Keeps the optimiser from dropping the work being timed
+static volatile size_t s_sink = 0;
+
+/**
+ * Build the binary display frame the server sends for DISPLAY_JSON
+ */
+static void build_display_frame(void)
+{
+    const char *lines[LCD_ROWS] = {"Player 2 rolled", "Move 5 spaces"};
+    size_t pos = 0;
+    s_display_frame[pos++] = WIRE_VERSION;
+    s_display_frame[pos++] = WIRE_MSG_DISPLAY;
+    s_display_frame[pos++] = WIRE_DISPLAY_HAS_TEXT | WIRE_DISPLAY_HAS_BUTTONS;
+    s_display_frame[pos++] = 0x07;
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        size_t len = strlen(lines[row]);
+        s_display_frame[pos++] = (uint8_t)len;
+        memcpy(&s_display_frame[pos], lines[row], len);
+        pos += len;
+    }
+    s_display_frame_len = pos;
+}
+
+static size_t button_json(uint32_t seq)
+{
+    char payload[128];
+    int len = snprintf(payload, sizeof(payload),
+                       "{\"player\":\"%s\",\"button\":%d,\"session\":%lu,\"seq\":%lu,\"timestamp\":%lld,\"err\":%ld}",
+                       PLAYER_ID, 2, (unsigned long)SESSION, (unsigned long)seq, (long long)TIMESTAMP_MS, (long)12);
+    s_sink += (uint8_t)payload[len / 2];
+    return (size_t)len;
+}
+
+static size_t button_binary(uint32_t seq)
+{
+    uint8_t payload[128];
+    size_t len = wire_encode_button(payload, sizeof(payload), 2, SESSION, seq, TIMESTAMP_MS, 12);
+    s_sink += payload[len / 2];
+    return len;
+}
+
+static size_t ack_json(uint32_t)
+{
+    // mqtt_publish_ack sends the literal "OK"
+    const char *payload = "OK";
+    s_sink += (uint8_t)payload[1];
+    return strlen(payload);
+}
+
+static size_t ack_binary(uint32_t)
+{
+    uint8_t payload[WIRE_ACK_SIZE];
+    size_t len = wire_encode_ack(payload, sizeof(payload));
+    s_sink += payload[1];
+    return len;
+}
+
+static size_t display_json(uint32_t)
+{
+    display_update_t update;
+    if (display_parse(DISPLAY_JSON, sizeof(DISPLAY_JSON) - 1, &update) != ESP_OK)
+        return 0;
+    s_sink += update.button_mask;
+    return sizeof(DISPLAY_JSON) - 1;
+}
+
+static size_t display_binary(uint32_t)
+{
+    display_update_t update;
+    if (wire_decode_display(s_display_frame, s_display_frame_len, &update) != ESP_OK)
+        return 0;
+    s_sink += update.button_mask;
+    return s_display_frame_len;
+}
+
+static size_t button_ack_json(uint32_t)
+{
+    // Same lookups as on_button_ack in button_outbox.cpp
+    cJSON *root = cJSON_ParseWithLength(BUTTON_ACK_JSON, sizeof(BUTTON_ACK_JSON) - 1);
+    if (root == NULL)
+        return 0;
+    cJSON *session_item = cJSON_GetObjectItem(root, "session");
+    cJSON *seq_item = cJSON_GetObjectItem(root, "seq");
+    bool ok = cJSON_IsNumber(session_item) && cJSON_IsNumber(seq_item);
+    if (ok)
+        s_sink += (uint32_t)seq_item->valuedouble;
+    cJSON_Delete(root);
+    return ok ? sizeof(BUTTON_ACK_JSON) - 1 : 0;
+}
+
+static size_t button_ack_binary(uint32_t)
+{
+    uint32_t session;
+    uint32_t seq;
+    if (wire_decode_button_ack(BUTTON_ACK_FRAME, sizeof(BUTTON_ACK_FRAME), &session, &seq) != ESP_OK)
+        return 0;
+    s_sink += seq;
+    return sizeof(BUTTON_ACK_FRAME);
+}
+
+typedef size_t (*codec_fn)(uint32_t seq);
+
+typedef struct
+{
+    size_t bytes; // Payload bytes per message
+    double ns;    // Encode or decode time per message
+} result_t;
+
+static bool run(codec_fn fn, result_t *out)
+{
+    out->bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        size_t len = fn((uint32_t)i);
+        if (len == 0)
+            return false;
+        if (len > out->bytes)
+            out->bytes = len;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    out->ns = std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+    return true;
+}
+
+static bool same_display(void)
+{
+    display_update_t from_json;
+    display_update_t from_binary;
+    if (display_parse(DISPLAY_JSON, sizeof(DISPLAY_JSON) - 1, &from_json) != ESP_OK ||
+        wire_decode_display(s_display_frame, s_display_frame_len, &from_binary) != ESP_OK)
+        return false;
+    return from_json.has_text == from_binary.has_text && from_json.has_buttons == from_binary.has_buttons &&
+           from_json.button_mask == from_binary.button_mask &&
+           memcmp(&from_json.frame, &from_binary.frame, sizeof(from_json.frame)) == 0;
+}
+
+int main(void)
+{
+    static const struct
+    {
+        const char *name;
+        codec_fn json;
+        codec_fn binary;
+    } CODECS[] = {
+        {"button enc", button_json, button_binary},
+        {"ack enc", ack_json, ack_binary},
+        {"display dec", display_json, display_binary},
+        {"btn ack dec", button_ack_json, button_ack_binary},
+    };
+
+    build_display_frame();
+    if (!same_display())
+    {
+        fprintf(stderr, "display: JSON and binary frames decode differently\n");
+        return 1;
+    }
+
+    printf("%-11s | %10s %8s | %12s %10s | %7s %7s\n", "message", "JSON bytes", "JSON ns", "binary bytes", "binary ns",
+           "size", "speedup");
+
+    for (const auto &codec : CODECS)
+    {
+        result_t json, binary;
+        if (!run(codec.json, &json) || !run(codec.binary, &binary))
+        {
+            fprintf(stderr, "%s: codec failed\n", codec.name);
+            return 1;
+        }
+        printf("%-11s | %10zu %8.1f | %12zu %10.1f | %6.0f%% %6.2fx\n", codec.name, json.bytes, json.ns,
+               binary.bytes, binary.ns, 100.0 * binary.bytes / json.bytes, json.ns / binary.ns);
+    }
+    return 0;
+}